@@ -0,0 +1,58 @@
+// analysis.h
+
+#ifndef _ANALYSIS_H
+#define _ANALYSIS_H
+
+#define ANALYSIS_MAX_DIRTY 4096
+
+// alive nodes that reach each other through their neighbours or a channel. signals never
+// cross from one component into another, so every component can be stepped on
+// its own, and one that has nothing in flight and no clock due can be left alone
+typedef struct {
+  u32 first; // into members
+  u32 count; // 0 when it was taken apart by an edit
+  u32 clock_first; // into clocks
+  u32 clock_count;
+  u32 live_count;
+} Component;
+
+// what follows from the topology of the circuit, computed again on the first
+// use after an edit. an edit only takes apart the components around the nodes
+// it touched and fills them in again at the end, everything else keeps its id
+typedef struct {
+  Component* components;
+  u32 component_count;
+  u32* component; // of every alive node
+  u32* members; // alive nodes grouped by component
+  u32 member_count;
+  u32* clocks; // the CLOCK sources of each component, grouped the same way
+  u32 clock_count;
+  u32* channel_component; // of every channel, the component its nodes were added to
+  // a node is live when its sends can reach a PRINT. a dead node only ever
+  // sends to other dead nodes, so skipping them changes nothing that is printed
+  u8* live;
+  u32 live_count;
+  u32* queue;
+  u32* seeds;
+  u32* dirty; // nodes edited since the last update
+  u32 dirty_count;
+  u32 rebuilds; // component ids from before a rebuild mean nothing after it
+  u32 generation; // of the index it was computed from
+  u32 valid;
+} Analysis;
+
+struct Engine;
+
+void analysis_alloc(struct Engine* e, Arena* arena);
+
+// a node was placed, removed or changed type, NO_NODE when it can't be told
+// which ones did
+void analysis_touch(struct Engine* e, u32 id);
+
+// recompute when the circuit was edited since the last time
+void analysis_update(struct Engine* e);
+
+// the analysis is up to date with the circuit
+u32 analysis_current(struct Engine* e);
+
+#endif // _ANALYSIS_H
@@ -0,0 +1,59 @@
+// banks.h
+
+#ifndef _BANKS_H
+#define _BANKS_H
+
+#define BANK_BITS 16
+#define BANK_WORDS (1 << BANK_BITS)
+#define BANK_MASK (BANK_WORDS - 1)
+
+// the registers of a MEMORY node. data is widened to 64 bits so there is no
+// padding, a bank compares equal byte for byte when its state is equal
+typedef struct {
+  u32 node;
+  u32 address; // set from the left, the word at it goes out to the right
+  u64 data; // set from above, stored at the address by a write from below
+} Bank;
+
+// the words of every MEMORY node, in one pool owned by the engine instead of in
+// the node values. the words of banks[b] start at words[b * BANK_WORDS]
+typedef struct {
+  Bank* banks;
+  Node_value* words;
+  u32 count;
+  u32 max;
+  u32* bank; // of every node, the index of its bank or NO_NODE
+} Banks;
+
+struct Engine;
+
+void banks_alloc(struct Engine* e, Arena* arena);
+
+// give a MEMORY node a bank of zeroes, or drop the bank of a node that no longer
+// is one
+void banks_update(struct Engine* e, u32 id);
+
+// match the banks to the MEMORY nodes again after the nodes were replaced
+void banks_rebuild(struct Engine* e);
+
+// NULL when the pool couldn't grow to hold it
+Bank* banks_of(struct Engine* e, u32 id);
+
+Node_value* banks_words(struct Engine* e, Bank* bank);
+
+// the banks of a state file, after the node fields
+void banks_write(Banks* banks, Buffer* buffer);
+
+// into banks of their own, they only replace those of the engine once the whole
+// file parsed
+Result banks_read(Banks* banks, Buffer* buffer, u32* iter);
+
+void banks_replace(struct Engine* e, Banks* banks);
+
+void banks_free(Banks* banks);
+
+// fill the bank of a MEMORY node from a file of raw words of this build's
+// width, for using it as a ROM
+Result banks_load(struct Engine* e, u32 id, const char* path);
+
+#endif // _BANKS_H
@@ -0,0 +1,54 @@
+// batch.h
+
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#define MAX_BATCH_LANE 256
+
+typedef struct {
+  u32 input; // id of the node that was read
+  Node_value value;
+} Batch_print;
+
+// K instances (lanes) of one circuit stepped together by the sync mode rules.
+// the topology is copied when the batch is created, and every per-node field
+// holds the values of all lanes next to each other, so a node steps every lane
+// with the same straight loop
+typedef struct {
+  u32 lanes;
+  u32 count;
+  u32* ids; // slot to node id
+  u32* slots; // node id to slot, or NO_NODE
+  u32 max_node;
+  u8* type;
+  u32 (*dir)[MAX_DIR]; // neighbour slots
+  Node_value* value; // [slot * lanes + lane]
+  Node_value* prev;
+  u8* sends[2];
+  u32 current;
+  Batch_print* prints; // [lane * max_print + i], from the last beat
+  u32* print_count;
+  u32 max_print;
+  u64 event_count;
+} Batch;
+
+struct Engine;
+
+// copy the circuit of an engine into every lane, with the values and sends it has now
+Result batch_create(Batch* b, struct Engine* e, u32 lanes);
+
+void batch_destroy(Batch* b);
+
+void batch_set_value(Batch* b, u32 lane, u32 id, Node_value value);
+
+Node_value batch_value(Batch* b, u32 lane, u32 id);
+
+// make a node of one lane send to all of its neighbours on the next beat
+void batch_fire(Batch* b, u32 lane, u32 id);
+
+// what the PRINT nodes of a lane read on the last beat, in the order sync mode logs them
+Batch_print* batch_prints(Batch* b, u32 lane, u32* count);
+
+void batch_simulate_beat(Batch* b);
+
+#endif // _BATCH_H
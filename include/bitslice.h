@@ -0,0 +1,54 @@
+// bitslice.h
+
+#ifndef _BITSLICE_H
+#define _BITSLICE_H
+
+// one bit per node, a grid row is a whole number of words
+#define BITSLICE_WORD_BITS 64
+// every row below, carved from one block
+#define BITSLICE_ROWS (2 + 2 * MAX_DIR + 1 + 4 * MAX_DIR + 7)
+
+typedef u64* Bitslice_row;
+
+// sync mode for circuits where every node is boolean (no CLOCK, ADD or INCR
+// and every value 0 or 1), with values and sends packed so a whole row steps
+// with a handful of bitwise ops. while valid, the packed sends are the ones in
+// flight and the sends in Sync_buffers are stale until flushed
+typedef struct {
+  Bitslice_row value[2];
+  Bitslice_row send[2][MAX_DIR];
+  u32 current;
+  // derived from the circuit when packing
+  Bitslice_row alive;
+  Bitslice_row neighbour[MAX_DIR]; // has an alive neighbour in the direction
+  Bitslice_row neighbour_copy[MAX_DIR]; // that neighbour copies its value into us when it sends
+  Bitslice_row listen[MAX_DIR];
+  Bitslice_row out[MAX_DIR]; // directional copies sending in the direction
+  Bitslice_row bus;
+  Bitslice_row gate_and;
+  Bitslice_row gate_equals;
+  Bitslice_row gate_not;
+  Bitslice_row copy; // COPY and the directional copies, take the first input
+  Bitslice_row broadcast;
+  Bitslice_row print;
+  u32 valid;
+  u32 checked; // the circuit was checked and isn't boolean, until the next change
+  u32 generation;
+  u64* block;
+  u32 words; // in a row
+  u32 stride; // words per grid row
+} Bitslice;
+
+struct Engine;
+
+void bitslice_alloc(struct Engine* e, Arena* arena);
+
+// run a sync beat on the packed circuit, Err when the circuit isn't boolean or
+// the grid width isn't a multiple of the word size
+Result bitslice_beat(struct Engine* e);
+
+// hand the sends in flight back to Sync_buffers and repack on the next beat,
+// for when nodes were changed outside of a beat
+void bitslice_flush(struct Engine* e);
+
+#endif // _BITSLICE_H
@@ -0,0 +1,42 @@
+// channels.h
+
+#ifndef _CHANNELS_H
+#define _CHANNELS_H
+
+// the SEND and RECEIVE nodes on one channel id
+typedef struct {
+  u32 id;
+  u32 first; // into members, the SENDs and then the RECEIVEs, each by node id
+  u32 send_count;
+  u32 receive_count;
+} Channel;
+
+typedef struct {
+  u32 channel;
+  u32 type;
+  u32 node;
+} Channel_key;
+
+// channel id to the nodes on it, so a SEND reaches its receivers directly
+// wherever they are on the grid. built again on the first use after an edit
+typedef struct {
+  Channel* channels;
+  u32 channel_count;
+  u32* members;
+  u32* group; // of every SEND and RECEIVE, the index of its channel
+  Channel_key* keys;
+  u32 generation; // of the index it was built from
+  u32 valid;
+} Channels;
+
+struct Engine;
+
+void channels_alloc(struct Engine* e, Arena* arena);
+
+// build the table again when the circuit was edited since
+void channels_update(struct Engine* e);
+
+// the channel of a SEND or RECEIVE, the table has to be up to date
+Channel* channels_of(struct Engine* e, u32 id);
+
+#endif // _CHANNELS_H
@@ -0,0 +1,57 @@
+// clocks.h
+
+#ifndef _CLOCKS_H
+#define _CLOCKS_H
+
+#define CLOCK_DEFAULT_PERIOD 1
+
+// the next beat a CLOCK fires on
+typedef struct {
+  u64 due;
+  u32 node;
+} Clock_entry;
+
+// a CLOCK fires on the beats whose number is its phase modulo its period. the
+// ones that fire every beat are kept in a list, the others in a min-heap by the
+// beat they fire on next, so a beat only touches the clocks that are due
+typedef struct {
+  u64 now; // beats since the circuit was loaded
+  Clock_entry* heap;
+  u32 heap_count;
+  u32* every; // fire every beat, by id
+  u32 every_count;
+  u32* popped; // off the heap this beat
+  u32 popped_count;
+  u32* merged;
+  u32* due; // fire this beat, by id
+  u32 due_count;
+  u8* fires; // of every node, whether it is a clock that fires this beat
+  u64* wait;
+  u32 generation; // of the index it was built from
+  u32 valid;
+} Clocks;
+
+struct Engine;
+
+void clocks_alloc(struct Engine* e, Arena* arena);
+
+// the period or phase of a clock was changed
+void clocks_touch(struct Engine* e);
+
+// start counting beats again, for a circuit that was just loaded
+void clocks_reset(struct Engine* e);
+
+// move to the next beat and collect the clocks that fire on it
+void clocks_advance(struct Engine* e);
+
+// move ahead without firing anything, for beats that were run some other way
+void clocks_skip(struct Engine* e, u64 beats);
+
+// every clock fires every beat
+u32 clocks_uniform(struct Engine* e);
+
+// the beats until every clock that doesn't fire every beat fires next, by id,
+// as data that compares equal for equal states
+void clocks_pending(struct Engine* e, u64** wait, u64* size);
+
+#endif // _CLOCKS_H
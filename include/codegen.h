@@ -0,0 +1,50 @@
+// codegen.h
+
+#ifndef _CODEGEN_H
+#define _CODEGEN_H
+
+// everything a generated kernel touches, the kernel source declares the same
+// struct so the two have to be kept in sync
+typedef struct {
+  Node_value* value;
+  u8* reads;
+  u8* writes;
+  u8* ready;
+  u32* node_colors;
+  u64* event_count;
+  u32* not_ready;
+  u32* not_ready_count;
+  u8* not_ready_listed;
+  u8* fires; // the clocks due this beat
+  void (*print)(void* user, u32 input, u32 self);
+  void* user;
+} Kernel_context;
+
+typedef void (*kernel_beat)(Kernel_context* c);
+
+// a circuit compiled ahead of time to native code and loaded as a shared object
+typedef struct {
+  void* handle;
+  kernel_beat beat;
+  u32 generation;
+  u32 built; // a build was attempted for generation, whether it succeeded or not
+  u32 prune; // dead nodes were left out of the build
+  i32 pid; // of the compiler while a build runs, 0 otherwise
+  char dir[MAX_PATH_SIZE];
+} Native_kernel;
+
+struct Engine;
+
+// emit, compile and load a kernel for the current circuit, waiting for the
+// compiler
+Result codegen_build(struct Engine* e);
+
+void codegen_unload(struct Engine* e);
+
+// fire the clocks of a beat through the native kernel. after an edit the kernel
+// is rebuilt while the beats go on, they run on the netlist interpreter until
+// the compiler is done, or for good when the kernel can't be built or the
+// cascades of the circuit could run the native stack out
+void codegen_trigger_clocks(struct Engine* e);
+
+#endif // _CODEGEN_H
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <assert.h>
 #include <stdarg.h>
 
@@ -25,6 +26,9 @@ typedef enum { Ok, Err, Done, } Result;
 #define return_defer(value) do { result = (value); goto defer; } while (0)
 #define MAX_PATH_SIZE 128
 #define LENGTH(ARR) (sizeof(ARR) / sizeof(ARR[0]))
+#define CLAMP(X, LOW, HIGH) ((X) < (LOW) ? (LOW) : ((X) > (HIGH) ? (HIGH) : (X)))
+#define MIN(A, B) ((A) < (B) ? (A) : (B))
+#define MAX(A, B) ((A) > (B) ? (A) : (B))
 
 #define true 1
 #define false 0
@@ -53,6 +57,15 @@ typedef struct {
 
 #define BOX(X, Y, W, H) (Box) { .x = X, .y = Y, .w = W, .h = H, }
 
+// one page aligned block that allocations are carved out of and freed with all
+// at once. an arena without memory only counts, so running the allocations on
+// one first gives the size to reserve
+typedef struct {
+  u8* data;
+  u64 size;
+  u64 used;
+} Arena;
+
 #define UNIMPLEMENTED() do { printf("%s:%s:%d: not implemented yet\n", __FILE__, __FUNCTION__, __LINE__); assert(0); } while (0)
 
 void buffer_init(Buffer* buffer);
@@ -61,8 +74,19 @@ void buffer_init_new(Buffer* buffer, u32 size);
 
 void buffer_free(Buffer* buffer);
 
+void buffer_append(Buffer* buffer, const void* data, u32 size);
+
 u32 buffer_iterate(void* restrict dest, Buffer* source, u32 size, u32* iter);
 
+// reserve size bytes of zeroed memory, pages are only backed once touched.
+// huge_pages asks the kernel to back the block with huge pages
+Result arena_init(Arena* arena, u64 size, u32 huge_pages);
+
+// zeroed and cache line aligned, NULL when the arena is only counting
+void* arena_alloc(Arena* arena, u64 size);
+
+void arena_free(Arena* arena);
+
 Result file_read(const char* path, Buffer* buffer);
 
 Result file_write(const char* path, Buffer* buffer);
@@ -0,0 +1,17 @@
+// cycle.h
+
+#ifndef _CYCLE_H
+#define _CYCLE_H
+
+// beats remembered while looking for a repeat, a period has to fit in half of it
+#define CYCLE_HISTORY (1 << 18)
+
+struct Engine;
+
+// run a number of beats, hashing the state after each one. once a state comes
+// back and a second period confirms it exactly, the whole periods left are
+// skipped by advancing the tick and event count, and only the remainder is
+// simulated. returns the number of beats that were actually simulated
+u32 cycle_run(struct Engine* e, u32 beats);
+
+#endif // _CYCLE_H
@@ -0,0 +1,41 @@
+// grid.h
+
+#ifndef _GRID_H
+#define _GRID_H
+
+#define GRID_CHUNK_SIZE 32
+#define GRID_CHUNK_CELLS (GRID_CHUNK_SIZE * GRID_CHUNK_SIZE)
+#define GRID_BUCKETS 1024
+
+// a square of cells holding the id of the node placed in each, or NO_NODE
+typedef struct Grid_chunk {
+  i32 x;
+  i32 y;
+  u32 count; // placed nodes, the chunk is freed when it drops to 0
+  u32 ids[GRID_CHUNK_CELLS];
+  struct Grid_chunk* next; // in the same bucket
+} Grid_chunk;
+
+// where nodes are placed on an unbounded plane. only chunks with a node in
+// them are allocated, kept in a hash map keyed by chunk coordinates
+typedef struct {
+  Grid_chunk* buckets[GRID_BUCKETS];
+  u32 chunk_count;
+} Grid;
+
+// the node at a cell, or NO_NODE
+u32 grid_get(Grid* grid, i32 x, i32 y);
+
+// place a node in a cell, allocating the chunk on first use
+Result grid_set(Grid* grid, i32 x, i32 y, u32 id);
+
+// empty a cell, freeing the chunk when it was the last node in it
+void grid_clear(Grid* grid, i32 x, i32 y);
+
+void grid_destroy(Grid* grid);
+
+// division rounding towards negative infinity, for cells left of or above the
+// origin
+i32 grid_floor_div(i32 a, i32 b);
+
+#endif // _GRID_H
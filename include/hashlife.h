@@ -0,0 +1,58 @@
+// hashlife.h
+
+#ifndef _HASHLIFE_H
+#define _HASHLIFE_H
+
+#define HASHLIFE_MAX_LEVEL 40
+#define HASHLIFE_MAX_QUAD (1 << 21)
+#define HASHLIFE_MAX_MEMO (1 << 21)
+#define HASHLIFE_BUCKETS (1 << 20)
+
+// a square of 2^level by 2^level cells. equal squares are the same quad, so a
+// result computed for one is reused everywhere the square shows up
+typedef struct {
+  u32 child[4]; // nw, ne, sw, se, or the packed cell at level 0
+  u32 level;
+  u32 next; // in the same bucket
+} Quad;
+
+// the centre half of a quad advanced by 2^step beats
+typedef struct {
+  u32 quad;
+  u32 step;
+  u32 result;
+  u32 next;
+} Quad_memo;
+
+typedef struct {
+  Quad* quads;
+  u32 quad_count;
+  u32 max_quad;
+  u32* buckets;
+  Quad_memo* memos;
+  u32 memo_count;
+  u32 max_memo;
+  u32* memo_buckets;
+  u32 empty[HASHLIFE_MAX_LEVEL];
+  u32 full; // ran out of quads or memos, the result is garbage
+  // the grid in the plane, one cell per node
+  u32* cells;
+  u32 max_cell;
+  u32 width;
+  u32 height;
+  i32 origin_x;
+  i32 origin_y;
+} Hashlife;
+
+struct Engine;
+
+// advance the circuit by a number of beats with the sync mode rules on a
+// memoized quadtree. Err when the circuit can't be run this way (a node outside
+// of the home window or not at the id of its cell), values are wider than 16
+// bits or the tables filled up, the circuit is left untouched then. prints,
+// colors and the event count are not updated
+Result hashlife_advance(struct Engine* e, u32 beats);
+
+void hashlife_destroy(void);
+
+#endif // _HASHLIFE_H
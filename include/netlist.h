@@ -0,0 +1,81 @@
+// netlist.h
+
+#ifndef _NETLIST_H
+#define _NETLIST_H
+
+typedef struct {
+  u32 pc;
+  u32 input;
+  u32 channel; // NO_NODE unless a SEND writes to the RECEIVEs of this channel
+  u32 index;
+  u8 forward;
+  u8 sides; // of a MACRO, the sides it sends out of, its targets are found by side
+} Vm_frame;
+
+// one instruction per alive node, with the neighbours it talks to resolved to
+// instruction indices so the interpreter never touches the grid
+typedef struct {
+  u8 op;
+  u8 reads;
+  u8 count;
+  u32 node;
+  u32 in;
+  u32 out;
+  u32 targets[MAX_NEIGHBOUR];
+} Instruction;
+
+// program, pc (node id to instruction) and clocks hold one entry per node
+typedef struct {
+  Instruction* program;
+  u32 count;
+  u32* pc;
+  u32* clocks;
+  u32 clock_count;
+  u32 delay_count; // DELAY nodes, which only the interpreter on one vm runs
+  u32 channel_count; // SEND and RECEIVE nodes, same
+  u32 memory_count; // MEMORY nodes, which the native kernel leaves to the vm
+  u32 macro_count; // MACRO nodes, which share the frames of their body, same
+  u32 generation;
+  Vm_frame* frames; // for the vm of netlist_trigger_clocks
+  u32 max_frame;
+} Netlist;
+
+
+typedef struct {
+  u8 type;
+  Node_value value;
+} Vm_print;
+
+// interpreter state. a vm only dispatches nodes with ids in [first, last), it is
+// only given cascades that stay in them. prints are logged directly unless the
+// vm has a print buffer
+typedef struct {
+  u32 first;
+  u32 last;
+  Vm_frame* frames;
+  u32 frame_count;
+  u32 max_frame;
+  Vm_print* prints;
+  u32 print_count;
+  u32 max_print;
+  u32* not_ready;
+  u32 not_ready_count;
+  u64 event_count;
+} Vm;
+
+struct Engine;
+
+void netlist_alloc(struct Engine* e, Arena* arena);
+
+void netlist_compile(struct Engine* e);
+
+// compile the netlist if the circuit was edited since the last compile
+void netlist_update(struct Engine* e);
+
+// fire the clocks of a beat through the netlist interpreter
+void netlist_trigger_clocks(struct Engine* e);
+
+// fire the clock at pc on a vm and drain the cascade
+void netlist_fire(struct Engine* e, Vm* vm, u32 pc);
+
+#endif // _NETLIST_H
@@ -3,6 +3,24 @@
 #ifndef _NODE_H
 #define _NODE_H
 
+// the grid is unbounded, but it has a home window at the origin. a node placed
+// inside it takes the id of its cell (y * width + x) while that id is free,
+// which keeps the row layout the bit-sliced and hashlife paths rely on. the
+// size of the window is picked at runtime, and the window holds as many cells
+// as nodes can be placed in total. these are the default dimensions
+#define NODE_GRID_WIDTH 64
+#define NODE_GRID_HEIGHT 64
+#define MAX_GRID_NODES (1 << 26)
+
+#define MAX_NEIGHBOUR 4
+#define MAX_READS 4
+#define MAX_WRITES 4
+#define NODE_DEFAULT_DELAY 4
+
+#define NODE_PADDING 2
+#define NODE_WIDTH 38
+#define NODE_HEIGHT 38
+
 typedef enum {
   NODE_NONE = 0,
   NODE_CLOCK,
@@ -18,6 +36,11 @@ typedef enum {
   NODE_COPY_RL,
   NODE_COPY_UD,
   NODE_COPY_DU,
+  NODE_DELAY,
+  NODE_SEND,
+  NODE_RECEIVE,
+  NODE_MEMORY,
+  NODE_MACRO,
 
   MAX_NODE_TYPE,
 } Node_type;
@@ -37,32 +60,150 @@ const char* node_type_str[MAX_NODE_TYPE] = {
   [NODE_COPY_RL] = "copy rl",
   [NODE_COPY_UD] = "copy ud",
   [NODE_COPY_DU] = "copy du",
+  [NODE_DELAY]   = "delay",
+  [NODE_SEND]    = "send",
+  [NODE_RECEIVE] = "receive",
+  [NODE_MEMORY]  = "memory",
+  [NODE_MACRO]   = "macro",
+};
+
+// interchangeable implementations of the propagation rules, they all work on
+// the same Nodes so the engine can be switched between beats
+typedef enum {
+  SIM_ENGINE_EVENT = 0,
+  SIM_ENGINE_VM,
+  SIM_ENGINE_NATIVE,
+  SIM_ENGINE_TILES,
+
+  MAX_SIM_ENGINE,
+} Sim_engine;
+
+const char* sim_engine_str[MAX_SIM_ENGINE] = {
+  [SIM_ENGINE_EVENT]  = "event",
+  [SIM_ENGINE_VM]     = "vm",
+  [SIM_ENGINE_NATIVE] = "native",
+  [SIM_ENGINE_TILES]  = "tiles",
+};
+
+// how a beat moves signals through the circuit. a cascade follows every signal
+// to the end within the beat, in sync mode every node steps once per beat from
+// the values of the previous beat. change mode steps like sync, but a node
+// keeps the last value heard from each side and only sends when its value
+// changed, so logic that holds still costs nothing
+typedef enum {
+  SIM_MODE_CASCADE = 0,
+  SIM_MODE_SYNC,
+  SIM_MODE_CHANGE,
+
+  MAX_SIM_MODE,
+} Sim_mode;
+
+const char* sim_mode_str[MAX_SIM_MODE] = {
+  [SIM_MODE_CASCADE] = "cascade",
+  [SIM_MODE_SYNC]    = "sync",
+  [SIM_MODE_CHANGE]  = "change",
 };
 
+// width of a node value in bits, picked at build time (make VALUE_BITS=32).
+// narrow values pack more nodes into a cache line, wide ones count further
+// before wrapping around
+#ifndef NODE_VALUE_BITS
+  #define NODE_VALUE_BITS 16
+#endif
+
+#if NODE_VALUE_BITS == 8
+  typedef u8 Node_value;
+  #define NODE_VALUE_FMT "%u"
+  #define NODE_VALUE_C_TYPE "uint8_t"
+#elif NODE_VALUE_BITS == 16
+  typedef u16 Node_value;
+  #define NODE_VALUE_FMT "%u"
+  #define NODE_VALUE_C_TYPE "uint16_t"
+#elif NODE_VALUE_BITS == 32
+  typedef u32 Node_value;
+  #define NODE_VALUE_FMT "%u"
+  #define NODE_VALUE_C_TYPE "uint32_t"
+#elif NODE_VALUE_BITS == 64
+  typedef u64 Node_value;
+  #define NODE_VALUE_FMT "%" PRIu64
+  #define NODE_VALUE_C_TYPE "uint64_t"
+#else
+  #error "NODE_VALUE_BITS must be 8, 16, 32 or 64"
+#endif
+
 typedef union {
   struct {
-    u16 value;
+    Node_value value;
   };
 } Node_data;
 
+#define NO_NODE ((u32)-1)
+
+// simulation fields, one dense array of max_node entries per field indexed by
+// node id
+typedef struct {
+  u32 grid_width; // of the home window
+  u32 grid_height;
+  u32 max_node;
+  u8* type;
+  Node_data* data;
+  u8* alive;
+  u8* reads;
+  u8* writes;
+  u8* ready;
+  i32* x; // grid position
+  i32* y;
+  u32* delay; // beats a DELAY holds what it read before sending it on
+  u32* period; // a CLOCK fires every period beats
+  u32* phase; // on the beats that are this modulo the period
+  u32* channel; // a SEND writes to the RECEIVEs of the same channel
+  u32* body; // the subcircuit a MACRO runs
+} Nodes;
+
+// compact, id-sorted lists of the nodes the simulation has to visit, derived
+// from Nodes and kept in sync on edit so per-beat work scales with the circuit
 typedef struct {
-  Box box;
-  Node_type type;
-  Node_data data;
-  u16 alive;
-  u16 reads;
-  u16 writes;
-  u16 ready;
-  u16 id;
-  u32 color;
-  u32 target_color;
-} __attribute__((packed, aligned(sizeof(u32)))) Node;
+  u32* alive;
+  u32 alive_count;
+  u32* clocks;
+  u32 clock_count;
+  u32* channel_nodes; // SEND and RECEIVE
+  u32 channel_node_count;
+  u32* not_ready;
+  u32 not_ready_count;
+  u8* not_ready_listed;
+  u32 generation; // bumped on every edit, compiled forms of the circuit compare against it
+} Node_index;
+
+// neighbour directions, in the order a broadcast visits them
+typedef enum {
+  DIR_LEFT = 0,
+  DIR_RIGHT,
+  DIR_UP,
+  DIR_DOWN,
+
+  MAX_DIR,
+} Direction;
+
+#define OPPOSITE(DIR) ((DIR) ^ 1)
+
+// precomputed adjacency of alive nodes. dir holds the alive neighbour in every
+// direction (or NO_NODE) and is patched around a node when it is edited, ids
+// holds the same neighbours packed per node in broadcast order (CSR) and is
+// recompiled from dir over the alive list before the next event when dirty
+typedef struct {
+  u32 (*dir)[MAX_DIR];
+  u32* offset;
+  u8* count;
+  u32* ids; // max_node * MAX_NEIGHBOUR
+  u32 dirty;
+} Node_graph;
 
 struct Engine;
 struct State;
 
-typedef void (*broadcast_event)(Node* self, Node* input, struct Engine* e);
-typedef void (*node_event)(Node* self, Node* input, struct Engine* e);
+typedef void (*broadcast_event)(u32 self, u32 input, struct Engine* e);
+typedef void (*node_event)(u32 self, u32 input, struct Engine* e);
 
 typedef struct {
   node_event event;
@@ -70,16 +211,54 @@ typedef struct {
   u32 reads;
 } Node_event;
 
-void node_init(Node* node, Box box, Node_type type);
+typedef void (*beat_event)(struct Engine* e);
+
+Box node_box(i32 x, i32 y);
+
+void node_init(Nodes* nodes, u32 id, Node_type type);
 
-void node_reset(Node* node);
+void node_reset(Nodes* nodes, u32 id);
 
-void node_clear(Node* node);
+void node_clear(Nodes* nodes, u32 id);
 
 void node_grid_init(struct State* state);
 
+// carve the node fields for a home window of the given size out of an arena
+void nodes_alloc(Nodes* nodes, Arena* arena, u32 grid_width, u32 grid_height);
+
+// carve the index, the graph and the event frames out of an arena, sized for the
+// nodes of the state
+void node_index_alloc(struct Engine* e, Arena* arena);
+
+void node_index_rebuild(struct Engine* e);
+
+// update the index lists and neighbour graph after the type or alive flag of a node changed
+void node_index_update(struct Engine* e, u32 id);
+
+void node_graph_compile(struct Engine* e);
+
+// the node in a grid cell, a free id is taken for it when the cell is empty.
+// NO_NODE when every id is in use
+u32 node_place(struct Engine* e, i32 x, i32 y);
+
+// take a node off the grid and free its id
+void node_remove(struct Engine* e, u32 id);
+
+// the node sits in the home window at the id of its cell
+u32 node_at_home(Nodes* nodes, u32 id);
+
+// mark a node as done for this beat and queue it to be made ready on the next
+void node_set_not_ready(struct Engine* e, u32 id);
+
+// run one beat of the simulation without touching input or the renderer
+void nodes_simulate_beat(struct Engine* e);
+
+// run as many whole beats as the time accumulated in the state timer covers,
+// or as many as fit in the beat budget at max speed
+u32 nodes_run_beats(struct Engine* e);
+
 void nodes_update_and_render(struct Engine* e);
 
-void node_render_info_box(struct Engine* e, Node* node);
+void node_render_info_box(struct Engine* e, u32 node);
 
 #endif
@@ -61,6 +61,7 @@ typedef enum {
 extern u8 key_down[];
 extern u8 key_pressed[];
 extern u32 key_mod_ctrl;
+extern u32 key_mod_shift;
 
 extern i32 mouse_x;
 extern i32 mouse_y;
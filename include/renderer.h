@@ -37,6 +37,11 @@ typedef enum {
   SPRITE_NODE_COPY_RL,
   SPRITE_NODE_COPY_UD,
   SPRITE_NODE_COPY_DU,
+  SPRITE_NODE_DELAY, // drawn as its delay
+  SPRITE_NODE_SEND, // drawn as their channel
+  SPRITE_NODE_RECEIVE,
+  SPRITE_NODE_MEMORY,
+  SPRITE_NODE_MACRO, // drawn as its subcircuit
 
   MAX_SPRITE,
 } Sprite_id;
@@ -11,12 +11,23 @@
 #include "platform.h"
 #include "renderer.h"
 #include "node.h"
+#include "grid.h"
+#include "analysis.h"
+#include "wheel.h"
+#include "clocks.h"
+#include "channels.h"
+#include "banks.h"
+#include "netlist.h"
+#include "subcircuits.h"
+#include "codegen.h"
+#include "tiles.h"
+#include "sync.h"
+#include "bitslice.h"
+#include "batch.h"
+#include "cycle.h"
+#include "hashlife.h"
 #include "camera.h"
 
-#define NODE_GRID_WIDTH 64
-#define NODE_GRID_HEIGHT 64
-#define MAX_NODE (NODE_GRID_WIDTH * NODE_GRID_HEIGHT)
-
 #define DEFAULT_PADDING 2
 #define DEFAULT_GLYPH_SIZE 2
 
@@ -42,8 +53,9 @@ typedef struct State {
   u32 tick;
   u32 paused;
   Camera camera;
-  Node nodes[MAX_NODE];
-} __attribute__((packed, aligned(sizeof(u32)))) State;
+  Nodes nodes;
+  u32 mode; // Sim_mode
+} State;
 
 typedef struct Engine {
   // serializable state
@@ -53,6 +65,31 @@ typedef struct Engine {
   i32 buffer_fd;
   u32 show_info_box;
   u32 show_log_box;
+  u64 event_count;
+  Sim_engine sim_engine;
+  u32 beat_cap; // most beats run in one frame, 0 for no limit
+  u32 max_speed; // ignore bpm and run beats until beat_budget is spent
+  f32 beat_budget; // seconds of every frame max speed may spend on beats
+  u32 frame_beats; // beats run in the last frame
+  u32 hashlife; // run sync mode beats on the memoized quadtree when it can
+  u32 prune; // skip the nodes that can't reach a PRINT
+  u32* node_colors;
+  Arena state_arena; // the node arrays of state
+  Arena arena; // everything derived from the nodes, sized by the grid
+  u32 huge_pages;
+  Grid grid;
+  Node_index index;
+  Node_graph graph;
+  Netlist netlist;
+  Native_kernel native;
+  Sync_buffers sync;
+  Bitslice bits;
+  Analysis analysis;
+  Wheel wheel;
+  Clocks clocks;
+  Channels channels;
+  Banks banks;
+  Subcircuits subcircuits;
 } Engine;
 
 i32 signal_engine_start(i32 argc, char** argv);
@@ -61,6 +98,6 @@ void signal_engine_log(Engine* e, const char* tag, const char* format, ...);
 
 void signal_engine_state_store(const char* path, Engine* e);
 
-void signal_engine_state_load(const char* path, Engine* e);
+Result signal_engine_state_load(const char* path, Engine* e);
 
 #endif // _SIGNAL_ENGINE_H
@@ -0,0 +1,118 @@
+// subcircuits.h
+
+#ifndef _SUBCIRCUITS_H
+#define _SUBCIRCUITS_H
+
+#define SUBCIRCUIT_MAGIC 0x42555353 // "SSUB"
+#define SUBCIRCUIT_VERSION 1
+#define MAX_SUBCIRCUIT_SIDE 64
+#define NO_CELL 0xff // type of a cell of a body that holds no node
+
+// a rectangle of the grid, captured once and shared by every MACRO node that
+// runs it. its nodes are compiled to a program over their index in the body,
+// and a target at or past count is the side of the MACRO a signal leaves by
+// (count plus its direction). the middle cell of every edge is the port of that
+// side, what comes in on a side is read by it
+typedef struct {
+  u32 width;
+  u32 height;
+  u32 count; // nodes, the values every instance keeps
+  u8* cells; // type of every cell, row by row, or NO_CELL
+  u32* index; // of every cell, its node or NO_NODE
+  Node_value* value; // of every node when captured, what an instance starts with
+  Instruction* program;
+  Vm_frame* frames;
+  u32 port[MAX_DIR]; // the node on the middle of each edge, or NO_NODE
+  u32 copies; // sides whose port copies its value into the neighbour there
+  u32 prints; // it holds a PRINT, so a MACRO running it is a sink
+} Body;
+
+// what a MACRO node keeps of its own, its values are in the pool. out holds by
+// side the last value that left the body there, cascades use the first buffer
+// and sync mode the one of the parity of the beat it left on. all fields are
+// 32 bits or values so an instance has no padding and compares byte for byte
+typedef struct {
+  u32 node;
+  u32 body;
+  u32 first; // of its values in the pool
+  u32 count;
+  u32 touched; // the flags of its nodes were set this beat
+  u32 has_emitted; // sides, in change mode
+  Node_value out[2][MAX_DIR];
+  Node_value emitted[MAX_DIR];
+} Instance;
+
+// the bodies, and the values of every MACRO node in one pool owned by the
+// engine, so a copy of a subcircuit costs one node on the grid and its values
+typedef struct {
+  Body* bodies;
+  u32 body_count;
+  Instance* instances;
+  u32 count;
+  u32 max;
+  Node_value* values;
+  u8* reads; // same layout as the values, cleared at the start of a beat
+  u8* writes;
+  u32 used;
+  u32 max_value;
+  u32* touched; // instances whose flags were set this beat
+  u32 touched_count;
+  u32* instance; // of every node, the index of its instance or NO_NODE
+  const char* path; // a captured region is saved to it, numbered
+} Subcircuits;
+
+struct Engine;
+
+void subcircuits_alloc(struct Engine* e, Arena* arena);
+
+// give a MACRO node the values of its body, or drop the instance of a node that
+// no longer is one or runs another body now
+void subcircuits_update(struct Engine* e, u32 id);
+
+// match the instances to the MACRO nodes again after the nodes were replaced
+void subcircuits_rebuild(struct Engine* e);
+
+// clear the read and write counts of the bodies that ran on the last beat
+void subcircuits_ready(struct Engine* e);
+
+// NULL when the node runs no body
+Instance* subcircuits_of(struct Engine* e, u32 id);
+
+// deliver a value from a side to the port of the body of a MACRO and drain the
+// cascade inside it. returns the sides a signal left by, with the last value
+// that left each of them in out. copy is set when the sender copies its value
+// into the receiver, type is that of the sender for the prints
+u32 subcircuits_run(struct Engine* e, u32 id, u32 side, Node_value value, u32 copy, u8 type, Node_value* out);
+
+// whether what a MACRO sends on a side is copied into the receiver
+u32 subcircuits_copies(struct Engine* e, u32 id, u32 side);
+
+// whether a MACRO holds a PRINT, and so is live whatever it sends to
+u32 subcircuits_prints(struct Engine* e, u32 id);
+
+// the sides whose value changed since they last sent in change mode, and
+// remember what they send now
+u32 subcircuits_changed(struct Engine* e, u32 id, u32 sides, Node_value* out);
+
+// forget what a MACRO sent in change mode, every MACRO for NO_NODE
+void subcircuits_forget(struct Engine* e, u32 id);
+
+// make a body of the rectangle between two corners, append it to the bodies and
+// save it to a file of its own, the path with the number of the body in it
+Result subcircuits_capture(struct Engine* e, i32 x0, i32 y0, i32 x1, i32 y1);
+
+// append the body of a file, unless an equal one is there already
+Result subcircuits_load(struct Engine* e, const char* path);
+
+// the bodies and the instances of a state file, after the banks
+void subcircuits_write(Subcircuits* subcircuits, Buffer* buffer);
+
+// into a table of its own, it only replaces that of the engine once the whole
+// file parsed
+Result subcircuits_read(Subcircuits* subcircuits, Buffer* buffer, u32* iter);
+
+void subcircuits_replace(struct Engine* e, Subcircuits* subcircuits);
+
+void subcircuits_free(Subcircuits* subcircuits);
+
+#endif // _SUBCIRCUITS_H
@@ -0,0 +1,60 @@
+// sync.h
+
+#ifndef _SYNC_H
+#define _SYNC_H
+
+#define SYNC_CHANNEL (1 << MAX_DIR) // a SEND wrote to its channel
+
+// double buffers for the synchronous mode. values are copied into the read
+// buffer at the start of a beat and every node writes its own next value, the
+// directions a node sends to alternate between two buffers by beat parity
+typedef struct {
+  Node_value* value;
+  u8* sends[2];
+  u32 current;
+  // change mode, the last value heard from each side and the last value sent
+  Node_value (*latch)[MAX_DIR];
+  u8* latched;
+  Node_value* emitted;
+  u8* has_emitted;
+  // the alive nodes of the components that step, in id order. a component
+  // without clocks is left out once it stepped twice without sending, both
+  // send buffers are clear for it then. when pruning, dead nodes are left out
+  u32* active;
+  u32 active_count;
+  u32* stepping; // those components
+  u32 stepping_count;
+  u8* quiet; // beats in a row a component stepped without sending
+  u8* sent; // a component sent on this beat
+  u32 schedule_generation; // of the analysis it was made from
+  u32 schedule_rebuilds;
+  u32 schedule_components; // the ones that existed then
+  u32 schedule_prune;
+  u32 wake_all; // woken before the component ids were known
+  u32 scheduled;
+} Sync_buffers;
+
+struct Engine;
+
+// carve one entry per node for every buffer
+void sync_alloc(struct Engine* e, Arena* arena);
+
+// drop every signal in flight
+void sync_reset(struct Engine* e);
+
+// drop the signals a node has in flight, after it was edited
+void sync_reset_node(struct Engine* e, u32 id);
+
+// node values were changed outside of a sync beat
+void sync_touch(struct Engine* e);
+
+// make a node send to all of its neighbours on the next beat
+void sync_fire(struct Engine* e, u32 id);
+
+// let the component of a node step again, or every component for NO_NODE, after
+// signals were put in flight outside of a sync beat
+void sync_wake(struct Engine* e, u32 id);
+
+void sync_simulate_beat(struct Engine* e);
+
+#endif // _SYNC_H
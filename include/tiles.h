@@ -0,0 +1,28 @@
+// tiles.h
+
+#ifndef _TILES_H
+#define _TILES_H
+
+// the grid is cut into bands of whole rows, so a tile owns a contiguous range of
+// node ids. the number of tiles follows the grid dimensions, the buffers are
+// sized on the first beat after they change
+#define TILE_ROWS 4
+#define MAX_TILE_WORKER 64
+
+struct Engine;
+
+// set the number of threads the tiles engine runs on, 0 picks one per core. there
+// is never more than one thread per tile
+void tiles_set_threads(u32 threads);
+
+// stop and join the worker threads and free the tiles
+void tiles_destroy(void);
+
+// run a beat over the tiles. the clocks of components that stay in one tile fire
+// on the threads, a tile at a time, and the components that cross tiles run on
+// this thread after them. prints are logged in the order of the clocks, so the
+// result is that of the vm whatever the thread count. a cascade is never split
+// between threads, so a circuit spanning more than one tile gains nothing
+void tiles_trigger_clocks(struct Engine* e);
+
+#endif // _TILES_H
@@ -0,0 +1,70 @@
+// wheel.h
+
+#ifndef _WHEEL_H
+#define _WHEEL_H
+
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4 // room for any u32 delay
+
+// a value a DELAY holds until the beat it is let go
+typedef struct {
+  u32 node;
+  u32 input; // the neighbour it came from, it isn't sent back there
+  u64 due; // beat of the wheel
+  u64 seq; // in the order they were scheduled
+  Node_value value;
+  u32 next;
+} Wheel_entry;
+
+// pending entry in the canonical order, for comparing states
+typedef struct {
+  u32 node;
+  u32 input;
+  u64 wait;
+  u64 order;
+  u64 value;
+} Wheel_pending;
+
+// hierarchical timing wheel. level 0 has a slot per beat for the next
+// WHEEL_SLOTS beats, every level above has a slot per whole turn of the level
+// below, and a slot is moved down a level when the level below comes round to
+// it, so scheduling and letting go costs the same for any delay
+typedef struct {
+  Wheel_entry* entries;
+  u32 max_entry;
+  u32 free; // list of unused entries
+  u32 count;
+  u32 slots[WHEEL_LEVELS][WHEEL_SLOTS]; // list heads
+  u64 now;
+  u64 seq;
+  Wheel_entry* due; // let go on this beat, by node id
+  u32 due_count;
+  u32 max_due;
+  Wheel_pending* pending;
+  u32 max_pending;
+} Wheel;
+
+struct Engine;
+
+// hold a value in a DELAY for its delay
+void wheel_schedule(struct Engine* e, u32 node, u32 input, Node_value value);
+
+// move to the next beat and collect the entries that are due on it
+void wheel_advance(struct Engine* e);
+
+// forget what a node was holding, after it was edited
+void wheel_cancel(struct Engine* e, u32 node);
+
+// move the wheel ahead without letting anything go, for beats that were skipped
+// over because they repeat. what is held stays as far from due as it was
+void wheel_skip(struct Engine* e, u64 beats);
+
+void wheel_clear(struct Engine* e);
+
+void wheel_destroy(struct Engine* e);
+
+// every pending entry as data that compares equal for equal states
+Result wheel_pending(struct Engine* e, Wheel_pending** pending, u64* size);
+
+#endif // _WHEEL_H
@@ -0,0 +1,272 @@
+// analysis.c
+
+static void analysis_components(Engine* e);
+static void analysis_patch(Engine* e);
+static void analysis_take_apart(Engine* e, u32 c, u32* seed_count);
+static void analysis_flood(Engine* e, u32 id);
+static void analysis_flood_channel(Engine* e, u32 id, u32 c);
+static void analysis_liveness(Engine* e, Component* component);
+static u32 analysis_sends(Nodes* nodes, u32 id, u32 dir);
+
+void analysis_alloc(Engine* e, Arena* arena) {
+  Analysis* analysis = &e->analysis;
+  u32 max_node = e->state.nodes.max_node;
+  analysis->components = arena_alloc(arena, sizeof(Component) * max_node);
+  analysis->component = arena_alloc(arena, sizeof(u32) * max_node);
+  analysis->members = arena_alloc(arena, sizeof(u32) * max_node);
+  analysis->clocks = arena_alloc(arena, sizeof(u32) * max_node);
+  analysis->channel_component = arena_alloc(arena, sizeof(u32) * max_node);
+  analysis->live = arena_alloc(arena, sizeof(u8) * max_node);
+  analysis->queue = arena_alloc(arena, sizeof(u32) * max_node);
+  // every alive node at most once, plus the edited ones again
+  analysis->seeds = arena_alloc(arena, sizeof(u32) * (max_node + ANALYSIS_MAX_DIRTY));
+  analysis->dirty = arena_alloc(arena, sizeof(u32) * ANALYSIS_MAX_DIRTY);
+  if (analysis->component) {
+    memset(analysis->component, 0xff, sizeof(u32) * max_node);
+  }
+  analysis->component_count = 0;
+  analysis->dirty_count = 0;
+  analysis->valid = false;
+}
+
+void analysis_touch(Engine* e, u32 id) {
+  Analysis* analysis = &e->analysis;
+  if (id == NO_NODE || analysis->dirty_count >= ANALYSIS_MAX_DIRTY) {
+    analysis->valid = false;
+    return;
+  }
+  analysis->dirty[analysis->dirty_count++] = id;
+}
+
+void analysis_update(Engine* e) {
+  Analysis* analysis = &e->analysis;
+  if (analysis_current(e)) {
+    return;
+  }
+  channels_update(e);
+  for (u32 i = 0; i < e->channels.channel_count; ++i) {
+    analysis->channel_component[i] = NO_NODE;
+  }
+  if (analysis->valid && analysis->dirty_count > 0) {
+    analysis_patch(e);
+  }
+  else {
+    analysis_components(e);
+  }
+  analysis->dirty_count = 0;
+  analysis->generation = e->index.generation;
+  analysis->valid = true;
+}
+
+u32 analysis_current(Engine* e) {
+  return e->analysis.valid && e->analysis.generation == e->index.generation;
+}
+
+// flood fill from every alive node that isn't in a component yet
+void analysis_components(Engine* e) {
+  Node_index* index = &e->index;
+  Analysis* analysis = &e->analysis;
+
+  // nodes that died since keep the component they had, clear by the old members
+  for (u32 c = 0; c < analysis->component_count; ++c) {
+    Component* component = &analysis->components[c];
+    for (u32 m = component->first; m < component->first + component->count; ++m) {
+      analysis->component[analysis->members[m]] = NO_NODE;
+    }
+  }
+  for (u32 i = 0; i < index->alive_count; ++i) {
+    analysis->component[index->alive[i]] = NO_NODE;
+  }
+  analysis->component_count = 0;
+  analysis->member_count = 0;
+  analysis->clock_count = 0;
+  analysis->live_count = 0;
+  for (u32 i = 0; i < index->alive_count; ++i) {
+    u32 id = index->alive[i];
+    if (analysis->component[id] == NO_NODE) {
+      analysis_flood(e, id);
+    }
+  }
+  analysis->rebuilds++;
+}
+
+// take apart the components of the edited nodes, of their neighbours and of the
+// nodes on their channel, then flood fill their alive nodes into new ones. the
+// old ones are left as holes until the next rebuild, which happens when the
+// space for new ones runs out
+void analysis_patch(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Node_graph* graph = &e->graph;
+  Channels* channels = &e->channels;
+  Analysis* analysis = &e->analysis;
+  u32 max_node = nodes->max_node;
+
+  u32 seed_count = 0;
+  for (u32 i = 0; i < analysis->dirty_count; ++i) {
+    u32 id = analysis->dirty[i];
+    if (analysis->component[id] == NO_NODE) {
+      if (nodes->alive[id]) {
+        analysis->seeds[seed_count++] = id;
+      }
+    }
+    else {
+      analysis_take_apart(e, analysis->component[id], &seed_count);
+    }
+    // a removed node still has its old neighbours
+    for (u32 d = 0; d < MAX_DIR; ++d) {
+      u32 n = graph->dir[id][d];
+      if (n != NO_NODE && analysis->component[n] != NO_NODE) {
+        analysis_take_apart(e, analysis->component[n], &seed_count);
+      }
+    }
+    // the channel it is on now, the one it was on before is in its old component
+    if (nodes->alive[id] && (nodes->type[id] == NODE_SEND || nodes->type[id] == NODE_RECEIVE)) {
+      Channel* channel = channels_of(e, id);
+      for (u32 m = channel->first; m < channel->first + channel->send_count + channel->receive_count; ++m) {
+        u32 n = channels->members[m];
+        if (analysis->component[n] != NO_NODE) {
+          analysis_take_apart(e, analysis->component[n], &seed_count);
+        }
+      }
+    }
+  }
+  if (analysis->component_count + seed_count > max_node || analysis->member_count + seed_count > max_node || analysis->clock_count + seed_count > max_node) {
+    analysis_components(e);
+    return;
+  }
+  for (u32 i = 0; i < seed_count; ++i) {
+    u32 id = analysis->seeds[i];
+    if (analysis->component[id] == NO_NODE) {
+      analysis_flood(e, id);
+    }
+  }
+}
+
+void analysis_take_apart(Engine* e, u32 c, u32* seed_count) {
+  Nodes* nodes = &e->state.nodes;
+  Analysis* analysis = &e->analysis;
+  Component* component = &analysis->components[c];
+  for (u32 m = component->first; m < component->first + component->count; ++m) {
+    u32 member = analysis->members[m];
+    analysis->component[member] = NO_NODE;
+    if (nodes->alive[member]) {
+      analysis->seeds[(*seed_count)++] = member;
+    }
+  }
+  analysis->live_count -= component->live_count;
+  component->count = 0;
+  component->clock_count = 0;
+  component->live_count = 0;
+}
+
+// the component of a node, with the members found so far as the queue
+void analysis_flood(Engine* e, u32 id) {
+  Nodes* nodes = &e->state.nodes;
+  Node_graph* graph = &e->graph;
+  Analysis* analysis = &e->analysis;
+
+  u32 c = analysis->component_count++;
+  Component* component = &analysis->components[c];
+  component->first = analysis->member_count;
+  component->clock_first = analysis->clock_count;
+  analysis->component[id] = c;
+  analysis->members[analysis->member_count++] = id;
+  for (u32 m = component->first; m < analysis->member_count; ++m) {
+    u32 member = analysis->members[m];
+    if (nodes->type[member] == NODE_CLOCK) {
+      analysis->clocks[analysis->clock_count++] = member;
+    }
+    if (nodes->type[member] == NODE_SEND || nodes->type[member] == NODE_RECEIVE) {
+      analysis_flood_channel(e, member, c);
+    }
+    for (u32 d = 0; d < MAX_DIR; ++d) {
+      u32 n = graph->dir[member][d];
+      if (n != NO_NODE && analysis->component[n] == NO_NODE) {
+        analysis->component[n] = c;
+        analysis->members[analysis->member_count++] = n;
+      }
+    }
+  }
+  component->count = analysis->member_count - component->first;
+  component->clock_count = analysis->clock_count - component->clock_first;
+  analysis_liveness(e, component);
+}
+
+// every node on the channel of a member joins its component, once per channel
+void analysis_flood_channel(Engine* e, u32 id, u32 c) {
+  Channels* channels = &e->channels;
+  Analysis* analysis = &e->analysis;
+  u32 group = channels->group[id];
+  if (analysis->channel_component[group] == c) {
+    return;
+  }
+  analysis->channel_component[group] = c;
+  Channel* channel = &channels->channels[group];
+  for (u32 m = channel->first; m < channel->first + channel->send_count + channel->receive_count; ++m) {
+    u32 n = channels->members[m];
+    if (analysis->component[n] == NO_NODE) {
+      analysis->component[n] = c;
+      analysis->members[analysis->member_count++] = n;
+    }
+  }
+}
+
+// walk the sends backwards from the PRINTs of the component
+void analysis_liveness(Engine* e, Component* component) {
+  Nodes* nodes = &e->state.nodes;
+  Node_graph* graph = &e->graph;
+  Analysis* analysis = &e->analysis;
+
+  u32 count = 0;
+  for (u32 m = component->first; m < component->first + component->count; ++m) {
+    u32 member = analysis->members[m];
+    analysis->live[member] = nodes->type[member] == NODE_PRINT || (nodes->type[member] == NODE_MACRO && subcircuits_prints(e, member));
+    if (analysis->live[member]) {
+      analysis->queue[count++] = member;
+    }
+  }
+  for (u32 i = 0; i < count; ++i) {
+    u32 id = analysis->queue[i];
+    // a RECEIVE hears from every SEND on its channel
+    if (nodes->type[id] == NODE_RECEIVE) {
+      Channel* channel = channels_of(e, id);
+      for (u32 m = channel->first; m < channel->first + channel->send_count; ++m) {
+        u32 n = e->channels.members[m];
+        if (!analysis->live[n]) {
+          analysis->live[n] = true;
+          analysis->queue[count++] = n;
+        }
+      }
+    }
+    for (u32 d = 0; d < MAX_DIR; ++d) {
+      u32 n = graph->dir[id][d];
+      if (n != NO_NODE && !analysis->live[n] && analysis_sends(nodes, n, OPPOSITE(d))) {
+        analysis->live[n] = true;
+        analysis->queue[count++] = n;
+      }
+    }
+  }
+  component->live_count = count;
+  analysis->live_count += count;
+}
+
+// whether a node can send to its neighbour in a direction
+u32 analysis_sends(Nodes* nodes, u32 id, u32 dir) {
+  switch (nodes->type[id]) {
+    case NODE_NONE:
+    case NODE_PRINT:
+    case NODE_SEND: // only to its channel
+      return false;
+    case NODE_COPY_LR:
+    case NODE_MEMORY:
+      return dir == DIR_RIGHT;
+    case NODE_COPY_RL:
+      return dir == DIR_LEFT;
+    case NODE_COPY_UD:
+      return dir == DIR_DOWN;
+    case NODE_COPY_DU:
+      return dir == DIR_UP;
+    default:
+      return true;
+  }
+}
@@ -0,0 +1,223 @@
+// banks.c
+
+#define BANKS_MIN 4
+
+static u32 banks_add(Engine* e, u32 id);
+static void banks_remove(Engine* e, u32 b);
+static Result banks_grow(Banks* banks, u32 count);
+static Result banks_field(Buffer* buffer, void* data, u32 size, u32* iter);
+
+void banks_alloc(Engine* e, Arena* arena) {
+  Banks* banks = &e->banks;
+  u32 max_node = e->state.nodes.max_node;
+  banks->bank = arena_alloc(arena, sizeof(u32) * max_node);
+  if (banks->bank) {
+    memset(banks->bank, 0xff, sizeof(u32) * max_node);
+  }
+}
+
+void banks_update(Engine* e, u32 id) {
+  Nodes* nodes = &e->state.nodes;
+  Banks* banks = &e->banks;
+  u32 memory = nodes->alive[id] && nodes->type[id] == NODE_MEMORY;
+  if (memory && banks->bank[id] == NO_NODE) {
+    banks_add(e, id);
+  }
+  else if (!memory && banks->bank[id] != NO_NODE) {
+    banks_remove(e, banks->bank[id]);
+  }
+}
+
+// the banks of nodes that are gone are dropped, and the MEMORY nodes left
+// without one get one
+void banks_rebuild(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  Banks* banks = &e->banks;
+  memset(banks->bank, 0xff, sizeof(u32) * nodes->max_node);
+  u32 kept = 0;
+  for (u32 b = 0; b < banks->count; ++b) {
+    u32 id = banks->banks[b].node;
+    if (id >= nodes->max_node || !nodes->alive[id] || nodes->type[id] != NODE_MEMORY || banks->bank[id] != NO_NODE) {
+      continue;
+    }
+    if (kept != b) {
+      banks->banks[kept] = banks->banks[b];
+      memcpy(&banks->words[(u64)kept * BANK_WORDS], &banks->words[(u64)b * BANK_WORDS], sizeof(Node_value) * BANK_WORDS);
+    }
+    banks->bank[id] = kept++;
+  }
+  banks->count = kept;
+  for (u32 i = 0; i < index->alive_count; ++i) {
+    u32 id = index->alive[i];
+    if (nodes->type[id] == NODE_MEMORY && banks->bank[id] == NO_NODE) {
+      banks_add(e, id);
+    }
+  }
+}
+
+Bank* banks_of(Engine* e, u32 id) {
+  u32 b = e->banks.bank[id];
+  return b != NO_NODE ? &e->banks.banks[b] : NULL;
+}
+
+Node_value* banks_words(Engine* e, Bank* bank) {
+  return &e->banks.words[(u64)(bank - e->banks.banks) * BANK_WORDS];
+}
+
+// the words up to the last one that isn't zero, most banks are mostly empty
+void banks_write(Banks* banks, Buffer* buffer) {
+  u32 bits = NODE_VALUE_BITS;
+  buffer_append(buffer, &bits, sizeof(bits));
+  buffer_append(buffer, &banks->count, sizeof(banks->count));
+  for (u32 b = 0; b < banks->count; ++b) {
+    Bank* bank = &banks->banks[b];
+    Node_value* words = &banks->words[(u64)b * BANK_WORDS];
+    u32 length = BANK_WORDS;
+    while (length > 0 && words[length - 1] == 0) {
+      --length;
+    }
+    buffer_append(buffer, bank, sizeof(*bank));
+    buffer_append(buffer, &length, sizeof(length));
+    buffer_append(buffer, words, sizeof(Node_value) * length);
+  }
+}
+
+Result banks_read(Banks* banks, Buffer* buffer, u32* iter) {
+  Result result = Ok;
+  u32 bits = 0;
+  u32 count = 0;
+  *banks = (Banks) {0};
+  if (banks_field(buffer, &bits, sizeof(bits), iter) != Ok || banks_field(buffer, &count, sizeof(count), iter) != Ok) {
+    return_defer(Err);
+  }
+  if (bits != 8 && bits != 16 && bits != 32 && bits != 64) {
+    log_error("banks_read: unsupported value width %u\n", bits);
+    return_defer(Err);
+  }
+  if (banks_grow(banks, count) != Ok) {
+    return_defer(Err);
+  }
+  for (u32 b = 0; b < count; ++b) {
+    Bank* bank = &banks->banks[b];
+    Node_value* words = &banks->words[(u64)b * BANK_WORDS];
+    u32 length = 0;
+    if (banks_field(buffer, bank, sizeof(*bank), iter) != Ok || banks_field(buffer, &length, sizeof(length), iter) != Ok) {
+      return_defer(Err);
+    }
+    if (length > BANK_WORDS || (u64)*iter + (u64)length * (bits / 8) > buffer->size) {
+      return_defer(Err);
+    }
+    memset(words, 0, sizeof(Node_value) * BANK_WORDS);
+    // words of another width are cut to the low bits, like the node values
+    for (u32 i = 0; i < length; ++i) {
+      u64 word = 0;
+      buffer_iterate(&word, buffer, bits / 8, iter);
+      words[i] = (Node_value)word;
+    }
+    bank->address &= BANK_MASK;
+    bank->data = (Node_value)bank->data;
+    banks->count++;
+  }
+defer:
+  if (result != Ok) {
+    banks_free(banks);
+  }
+  return result;
+}
+
+void banks_replace(Engine* e, Banks* banks) {
+  u32* bank = e->banks.bank;
+  banks_free(&e->banks);
+  e->banks = *banks;
+  e->banks.bank = bank;
+  *banks = (Banks) {0};
+}
+
+void banks_free(Banks* banks) {
+  free(banks->banks);
+  free(banks->words);
+  banks->banks = NULL;
+  banks->words = NULL;
+  banks->count = 0;
+  banks->max = 0;
+}
+
+Result banks_load(Engine* e, u32 id, const char* path) {
+  Result result = Ok;
+  Buffer buffer = {0};
+  if (id >= e->state.nodes.max_node || !banks_of(e, id)) {
+    log_error("banks_load: node %u is not a MEMORY node\n", id);
+    return_defer(Err);
+  }
+  if (file_read(path, &buffer) != Ok) {
+    return_defer(Err);
+  }
+  Node_value* words = banks_words(e, banks_of(e, id));
+  u32 length = MIN(buffer.size / sizeof(Node_value), BANK_WORDS);
+  memset(words, 0, sizeof(Node_value) * BANK_WORDS);
+  memcpy(words, buffer.data, sizeof(Node_value) * length);
+  if (buffer.size > sizeof(Node_value) * BANK_WORDS) {
+    log_info("banks_load: `%s` holds more than %u words, the rest was left out\n", path, BANK_WORDS);
+  }
+  signal_engine_log(e, "info", "loaded %u words into node %u", length, id);
+  buffer_free(&buffer);
+defer:
+  return result;
+}
+
+u32 banks_add(Engine* e, u32 id) {
+  Banks* banks = &e->banks;
+  if (banks_grow(banks, banks->count + 1) != Ok) {
+    log_error("banks: failed to allocate a bank for node %u\n", id);
+    return NO_NODE;
+  }
+  u32 b = banks->count++;
+  banks->banks[b] = (Bank) {
+    .node = id,
+    .address = 0,
+    .data = 0,
+  };
+  memset(&banks->words[(u64)b * BANK_WORDS], 0, sizeof(Node_value) * BANK_WORDS);
+  banks->bank[id] = b;
+  return b;
+}
+
+// the last bank moves into the hole
+void banks_remove(Engine* e, u32 b) {
+  Banks* banks = &e->banks;
+  u32 last = --banks->count;
+  banks->bank[banks->banks[b].node] = NO_NODE;
+  if (b != last) {
+    banks->banks[b] = banks->banks[last];
+    memcpy(&banks->words[(u64)b * BANK_WORDS], &banks->words[(u64)last * BANK_WORDS], sizeof(Node_value) * BANK_WORDS);
+    banks->bank[banks->banks[b].node] = b;
+  }
+}
+
+Result banks_grow(Banks* banks, u32 count) {
+  if (count <= banks->max) {
+    return Ok;
+  }
+  u32 max = MAX(MAX(2 * banks->max, count), BANKS_MIN);
+  Bank* grown = realloc(banks->banks, sizeof(Bank) * max);
+  if (!grown) {
+    return Err;
+  }
+  banks->banks = grown;
+  Node_value* words = realloc(banks->words, sizeof(Node_value) * BANK_WORDS * (u64)max);
+  if (!words) {
+    return Err;
+  }
+  banks->words = words;
+  banks->max = max;
+  return Ok;
+}
+
+Result banks_field(Buffer* buffer, void* data, u32 size, u32* iter) {
+  if ((u64)*iter + size > buffer->size) {
+    return Err;
+  }
+  buffer_iterate(data, buffer, size, iter);
+  return Ok;
+}
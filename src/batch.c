@@ -0,0 +1,336 @@
+// batch.c
+// sync_simulate_beat over many lanes at once. branches only depend on the
+// topology, what differs between lanes is selected with masks in loops over the
+// lanes of a node, which the compiler turns into vector code
+
+static void batch_step(Batch* b, u32 s);
+
+Result batch_create(Batch* b, Engine* e, u32 lanes) {
+  Result result = Ok;
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  Sync_buffers* sync = &e->sync;
+
+  memset(b, 0, sizeof(*b));
+  if (lanes == 0 || lanes > MAX_BATCH_LANE) {
+    log_error("number of lanes must be between 1 and %u\n", MAX_BATCH_LANE);
+    return_defer(Err);
+  }
+  sync_touch(e);
+  if (!clocks_uniform(e)) {
+    log_error("batches only run CLOCKs that fire every beat\n");
+    return_defer(Err);
+  }
+  if (index->channel_node_count > 0) {
+    log_error("batches don't run SEND and RECEIVE nodes\n");
+    return_defer(Err);
+  }
+
+  u32 count = index->alive_count;
+  u32 print_nodes = 0;
+  for (u32 i = 0; i < count; ++i) {
+    if (nodes->type[index->alive[i]] == NODE_DELAY) {
+      log_error("batches don't run DELAY nodes\n");
+      return_defer(Err);
+    }
+    if (nodes->type[index->alive[i]] == NODE_MEMORY) {
+      log_error("batches don't run MEMORY nodes\n");
+      return_defer(Err);
+    }
+    if (nodes->type[index->alive[i]] == NODE_MACRO) {
+      log_error("batches don't run MACRO nodes\n");
+      return_defer(Err);
+    }
+    print_nodes += nodes->type[index->alive[i]] == NODE_PRINT;
+  }
+  b->lanes = lanes;
+  b->count = count;
+  b->max_print = print_nodes * MAX_DIR;
+  b->ids = malloc(sizeof(u32) * (count + 1));
+  b->max_node = nodes->max_node;
+  b->slots = malloc(sizeof(u32) * b->max_node);
+  b->type = malloc(sizeof(u8) * (count + 1));
+  b->dir = malloc(sizeof(u32[MAX_DIR]) * (count + 1));
+  b->value = calloc((count + 1) * lanes, sizeof(Node_value));
+  b->prev = calloc((count + 1) * lanes, sizeof(Node_value));
+  b->sends[0] = calloc((count + 1) * lanes, sizeof(u8));
+  b->sends[1] = calloc((count + 1) * lanes, sizeof(u8));
+  b->prints = calloc((b->max_print + 1) * lanes, sizeof(Batch_print));
+  b->print_count = calloc(lanes, sizeof(u32));
+  if (!b->ids || !b->slots || !b->type || !b->dir || !b->value || !b->prev || !b->sends[0] || !b->sends[1] || !b->prints || !b->print_count) {
+    log_error("failed to allocate a batch of %u lanes\n", lanes);
+    batch_destroy(b);
+    return_defer(Err);
+  }
+
+  for (u32 i = 0; i < b->max_node; ++i) {
+    b->slots[i] = NO_NODE;
+  }
+  for (u32 s = 0; s < count; ++s) {
+    b->ids[s] = index->alive[s];
+    b->slots[index->alive[s]] = s;
+  }
+  for (u32 s = 0; s < count; ++s) {
+    u32 id = b->ids[s];
+    b->type[s] = nodes->type[id];
+    for (u32 d = 0; d < MAX_DIR; ++d) {
+      u32 n = e->graph.dir[id][d];
+      b->dir[s][d] = n == NO_NODE ? NO_NODE : b->slots[n];
+    }
+    for (u32 lane = 0; lane < lanes; ++lane) {
+      b->value[s * lanes + lane] = nodes->data[id].value;
+      b->sends[0][s * lanes + lane] = sync->sends[sync->current][id];
+    }
+  }
+defer:
+  return result;
+}
+
+void batch_destroy(Batch* b) {
+  free(b->ids);
+  free(b->slots);
+  free(b->type);
+  free(b->dir);
+  free(b->value);
+  free(b->prev);
+  free(b->sends[0]);
+  free(b->sends[1]);
+  free(b->prints);
+  free(b->print_count);
+  memset(b, 0, sizeof(*b));
+}
+
+void batch_set_value(Batch* b, u32 lane, u32 id, Node_value value) {
+  assert(lane < b->lanes && id < b->max_node);
+  u32 s = b->slots[id];
+  if (s != NO_NODE) {
+    b->value[s * b->lanes + lane] = value;
+  }
+}
+
+Node_value batch_value(Batch* b, u32 lane, u32 id) {
+  assert(lane < b->lanes && id < b->max_node);
+  u32 s = b->slots[id];
+  if (s == NO_NODE) {
+    return 0;
+  }
+  return b->value[s * b->lanes + lane];
+}
+
+void batch_fire(Batch* b, u32 lane, u32 id) {
+  assert(lane < b->lanes && id < b->max_node);
+  u32 s = b->slots[id];
+  if (s == NO_NODE) {
+    return;
+  }
+  u8 send = 0;
+  for (u32 d = 0; d < MAX_DIR; ++d) {
+    if (b->dir[s][d] != NO_NODE) {
+      send |= 1 << d;
+    }
+  }
+  b->sends[b->current][s * b->lanes + lane] = send;
+}
+
+Batch_print* batch_prints(Batch* b, u32 lane, u32* count) {
+  assert(lane < b->lanes);
+  *count = b->print_count[lane];
+  return &b->prints[lane * b->max_print];
+}
+
+void batch_simulate_beat(Batch* b) {
+  memcpy(b->prev, b->value, sizeof(Node_value) * b->count * b->lanes);
+  memset(b->print_count, 0, sizeof(u32) * b->lanes);
+  for (u32 s = 0; s < b->count; ++s) {
+    batch_step(b, s);
+  }
+  b->current = !b->current;
+}
+
+void batch_step(Batch* b, u32 s) {
+  const u32 lanes = b->lanes;
+  const u8 type = b->type[s];
+  const u32* dir = b->dir[s];
+  const u8* sent = b->sends[b->current];
+  u8* restrict send = &b->sends[!b->current][s * lanes];
+  Node_value* restrict value = &b->value[s * lanes];
+
+  u32 listen = (1 << MAX_DIR) - 1;
+  u32 out = NO_NODE;
+  switch (type) {
+    case NODE_COPY_LR:
+      listen = 1 << DIR_LEFT;
+      out = DIR_RIGHT;
+      break;
+    case NODE_COPY_RL:
+      listen = 1 << DIR_RIGHT;
+      out = DIR_LEFT;
+      break;
+    case NODE_COPY_UD:
+      listen = 1 << DIR_UP;
+      out = DIR_DOWN;
+      break;
+    case NODE_COPY_DU:
+      listen = 1 << DIR_DOWN;
+      out = DIR_UP;
+      break;
+    default:
+      break;
+  }
+
+  u16 count[MAX_BATCH_LANE];
+  u8 from[MAX_BATCH_LANE];
+  Node_value first[MAX_BATCH_LANE];
+  Node_value second[MAX_BATCH_LANE];
+  Node_value latest[MAX_BATCH_LANE];
+  Node_value sum[MAX_BATCH_LANE];
+  u8 fire[MAX_BATCH_LANE];
+  u8 neighbours = 0;
+  // only the lanes in use are cleared
+  memset(count, 0, lanes * sizeof(u16));
+  memset(from, 0, lanes * sizeof(u8));
+  memset(first, 0, lanes * sizeof(Node_value));
+  memset(second, 0, lanes * sizeof(Node_value));
+  memset(latest, 0, lanes * sizeof(Node_value));
+  memset(sum, 0, lanes * sizeof(Node_value));
+  memset(fire, 0, lanes * sizeof(u8));
+
+  for (u32 d = 0; d < MAX_DIR; ++d) {
+    u32 n = dir[d];
+    if (n == NO_NODE) {
+      continue;
+    }
+    neighbours |= 1 << d;
+    const u8* restrict n_sent = &sent[n * lanes];
+    const Node_value* restrict n_value = &b->prev[n * lanes];
+    const u32 shift = OPPOSITE(d);
+    switch (b->type[n]) {
+      case NODE_COPY:
+      case NODE_COPY_LR:
+      case NODE_COPY_RL:
+      case NODE_COPY_UD:
+      case NODE_COPY_DU:
+        // the sender copies into us before we read
+        for (u32 lane = 0; lane < lanes; ++lane) {
+          Node_value arrived = -(Node_value)((n_sent[lane] >> shift) & 1);
+          value[lane] = (value[lane] & ~arrived) | (n_value[lane] & arrived);
+        }
+        break;
+      default:
+        break;
+    }
+    if (!(listen & (1 << d))) {
+      continue;
+    }
+    if (type == NODE_PRINT) {
+      for (u32 lane = 0; lane < lanes; ++lane) {
+        if ((n_sent[lane] >> shift) & 1) {
+          b->prints[lane * b->max_print + b->print_count[lane]++] = (Batch_print) { .input = b->ids[n], .value = n_value[lane], };
+        }
+      }
+    }
+    // arrived is all ones in the lanes the input came in on
+    for (u32 lane = 0; lane < lanes; ++lane) {
+      Node_value arrived = -(Node_value)((n_sent[lane] >> shift) & 1);
+      Node_value is_first = arrived & -(Node_value)(count[lane] == 0);
+      Node_value is_second = arrived & -(Node_value)(count[lane] == 1);
+      first[lane] = (first[lane] & ~is_first) | (n_value[lane] & is_first);
+      second[lane] = (second[lane] & ~is_second) | (n_value[lane] & is_second);
+      latest[lane] = (latest[lane] & ~arrived) | (n_value[lane] & arrived);
+      sum[lane] += n_value[lane] & arrived;
+      from[lane] |= (arrived & 1) << d;
+      count[lane] += arrived & 1;
+    }
+  }
+
+  switch (type) {
+    case NODE_NONE:
+      break;
+    case NODE_PRINT:
+      for (u32 lane = 0; lane < lanes; ++lane) {
+        value[lane] = count[lane] > 0 ? latest[lane] : value[lane];
+      }
+      break;
+    case NODE_CLOCK:
+      for (u32 lane = 0; lane < lanes; ++lane) {
+        value[lane] += 1;
+        fire[lane] = true;
+      }
+      break;
+    case NODE_ADD:
+      for (u32 lane = 0; lane < lanes; ++lane) {
+        u8 two = count[lane] >= 2;
+        value[lane] += two * (Node_value)(first[lane] + second[lane]);
+        fire[lane] = two;
+      }
+      break;
+    case NODE_BUS:
+      for (u32 lane = 0; lane < lanes; ++lane) {
+        fire[lane] = count[lane] > 0;
+      }
+      break;
+    case NODE_AND:
+      for (u32 lane = 0; lane < lanes; ++lane) {
+        u8 two = count[lane] >= 2;
+        Node_value result = (first[lane] != 0) & (second[lane] != 0);
+        value[lane] = two ? result : value[lane];
+        fire[lane] = two & result;
+      }
+      break;
+    case NODE_INCR:
+      for (u32 lane = 0; lane < lanes; ++lane) {
+        value[lane] += sum[lane];
+        fire[lane] = count[lane] > 0;
+      }
+      break;
+    case NODE_NOT:
+      for (u32 lane = 0; lane < lanes; ++lane) {
+        value[lane] = count[lane] > 0 ? !first[lane] : value[lane];
+        fire[lane] = count[lane] > 0;
+      }
+      break;
+    case NODE_COPY:
+      for (u32 lane = 0; lane < lanes; ++lane) {
+        value[lane] = count[lane] > 0 ? first[lane] : value[lane];
+        fire[lane] = count[lane] > 0;
+      }
+      break;
+    case NODE_EQUALS:
+      for (u32 lane = 0; lane < lanes; ++lane) {
+        u8 two = count[lane] >= 2;
+        Node_value result = first[lane] == second[lane];
+        value[lane] = two ? result : value[lane];
+        fire[lane] = two & result;
+      }
+      break;
+    case NODE_COPY_LR:
+    case NODE_COPY_RL:
+    case NODE_COPY_UD:
+    case NODE_COPY_DU:
+      for (u32 lane = 0; lane < lanes; ++lane) {
+        value[lane] = count[lane] > 0 ? first[lane] : value[lane];
+        fire[lane] = (count[lane] > 0) & (dir[out] != NO_NODE);
+      }
+      break;
+    default:
+      assert(0);
+      break;
+  }
+
+  u64 events = 0;
+  if (out != NO_NODE) {
+    for (u32 lane = 0; lane < lanes; ++lane) {
+      send[lane] = fire[lane] ? 1 << out : 0;
+    }
+  }
+  else {
+    // broadcast to every neighbour except the ones we just heard from
+    for (u32 lane = 0; lane < lanes; ++lane) {
+      send[lane] = fire[lane] ? neighbours & ~from[lane] : 0;
+    }
+  }
+  for (u32 lane = 0; lane < lanes; ++lane) {
+    events += count[lane] > 0 || fire[lane];
+  }
+  b->event_count += events;
+}
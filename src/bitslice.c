@@ -0,0 +1,293 @@
+// bitslice.c
+// the same rules as sync_simulate_beat, restricted to 0/1 values and evaluated
+// 64 nodes at a time. every node has to sit at the id of its cell in the home
+// window, so ids run along the rows, the left and right neighbours are a one
+// bit shift of the whole grid and the ones above and below are a grid row of
+// words back and ahead. the shift carries across row ends, but nothing is sent
+// there since those cells aren't neighbours
+
+static u64* bitslice_take(u64** block, u32 words);
+static Result bitslice_pack(Engine* e);
+static void bitslice_print(Engine* e, u32 id, u64* value, u64 listen[MAX_DIR]);
+
+void bitslice_alloc(Engine* e, Arena* arena) {
+  Nodes* nodes = &e->state.nodes;
+  Bitslice* bits = &e->bits;
+  u32 words = (nodes->max_node + BITSLICE_WORD_BITS - 1) / BITSLICE_WORD_BITS;
+  bits->words = words;
+  bits->stride = nodes->grid_width / BITSLICE_WORD_BITS;
+  bits->block = arena_alloc(arena, sizeof(u64) * words * BITSLICE_ROWS);
+  if (!bits->block) {
+    return;
+  }
+  u64* block = bits->block;
+  for (u32 i = 0; i < 2; ++i) {
+    bits->value[i] = bitslice_take(&block, words);
+    for (u32 d = 0; d < MAX_DIR; ++d) {
+      bits->send[i][d] = bitslice_take(&block, words);
+    }
+  }
+  bits->alive = bitslice_take(&block, words);
+  for (u32 d = 0; d < MAX_DIR; ++d) {
+    bits->neighbour[d] = bitslice_take(&block, words);
+    bits->neighbour_copy[d] = bitslice_take(&block, words);
+    bits->listen[d] = bitslice_take(&block, words);
+    bits->out[d] = bitslice_take(&block, words);
+  }
+  bits->bus = bitslice_take(&block, words);
+  bits->gate_and = bitslice_take(&block, words);
+  bits->gate_equals = bitslice_take(&block, words);
+  bits->gate_not = bitslice_take(&block, words);
+  bits->copy = bitslice_take(&block, words);
+  bits->broadcast = bitslice_take(&block, words);
+  bits->print = bitslice_take(&block, words);
+  assert(block == bits->block + words * BITSLICE_ROWS);
+}
+
+u64* bitslice_take(u64** block, u32 words) {
+  u64* row = *block;
+  *block += words;
+  return row;
+}
+
+Result bitslice_pack(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  Node_graph* graph = &e->graph;
+  Sync_buffers* sync = &e->sync;
+  Bitslice* bits = &e->bits;
+
+  bits->valid = false;
+  bits->current = 0;
+  if (nodes->grid_width % BITSLICE_WORD_BITS != 0) {
+    return Err;
+  }
+  memset(bits->block, 0, sizeof(u64) * bits->words * BITSLICE_ROWS);
+
+  for (u32 i = 0; i < index->alive_count; ++i) {
+    u32 id = index->alive[i];
+    u32 w = id / BITSLICE_WORD_BITS;
+    u64 bit = 1ull << (id % BITSLICE_WORD_BITS);
+    u8 type = nodes->type[id];
+    if (nodes->data[id].value > 1 || !node_at_home(nodes, id)) {
+      return Err;
+    }
+
+    u32 listen = (1 << MAX_DIR) - 1;
+    u32 out = NO_NODE;
+    switch (type) {
+      case NODE_NONE:
+        break;
+      case NODE_PRINT:
+        bits->print[w] |= bit;
+        break;
+      case NODE_BUS:
+        bits->bus[w] |= bit;
+        bits->broadcast[w] |= bit;
+        break;
+      case NODE_AND:
+        bits->gate_and[w] |= bit;
+        bits->broadcast[w] |= bit;
+        break;
+      case NODE_EQUALS:
+        bits->gate_equals[w] |= bit;
+        bits->broadcast[w] |= bit;
+        break;
+      case NODE_NOT:
+        bits->gate_not[w] |= bit;
+        bits->broadcast[w] |= bit;
+        break;
+      case NODE_COPY:
+        bits->copy[w] |= bit;
+        bits->broadcast[w] |= bit;
+        break;
+      case NODE_COPY_LR:
+        listen = 1 << DIR_LEFT;
+        out = DIR_RIGHT;
+        break;
+      case NODE_COPY_RL:
+        listen = 1 << DIR_RIGHT;
+        out = DIR_LEFT;
+        break;
+      case NODE_COPY_UD:
+        listen = 1 << DIR_UP;
+        out = DIR_DOWN;
+        break;
+      case NODE_COPY_DU:
+        listen = 1 << DIR_DOWN;
+        out = DIR_UP;
+        break;
+      default:
+        // CLOCK, ADD and INCR count
+        return Err;
+    }
+    if (out != NO_NODE) {
+      bits->copy[w] |= bit;
+      if (graph->dir[id][out] != NO_NODE) {
+        bits->out[out][w] |= bit;
+      }
+    }
+
+    bits->alive[w] |= bit;
+    if (nodes->data[id].value) {
+      bits->value[0][w] |= bit;
+    }
+    for (u32 d = 0; d < MAX_DIR; ++d) {
+      u32 n = graph->dir[id][d];
+      if (listen & (1 << d)) {
+        bits->listen[d][w] |= bit;
+      }
+      if (n == NO_NODE) {
+        continue;
+      }
+      bits->neighbour[d][w] |= bit;
+      switch (nodes->type[n]) {
+        case NODE_COPY:
+        case NODE_COPY_LR:
+        case NODE_COPY_RL:
+        case NODE_COPY_UD:
+        case NODE_COPY_DU:
+          bits->neighbour_copy[d][w] |= bit;
+          break;
+        default:
+          break;
+      }
+      if (sync->sends[sync->current][id] & (1 << d)) {
+        bits->send[0][d][w] |= bit;
+      }
+    }
+  }
+  bits->valid = true;
+  return Ok;
+}
+
+void bitslice_flush(Engine* e) {
+  Node_index* index = &e->index;
+  Sync_buffers* sync = &e->sync;
+  Bitslice* bits = &e->bits;
+  if (bits->valid) {
+    for (u32 i = 0; i < index->alive_count; ++i) {
+      u32 id = index->alive[i];
+      u32 w = id / BITSLICE_WORD_BITS;
+      u32 shift = id % BITSLICE_WORD_BITS;
+      u8 send = 0;
+      for (u32 d = 0; d < MAX_DIR; ++d) {
+        send |= ((bits->send[bits->current][d][w] >> shift) & 1) << d;
+      }
+      sync->sends[sync->current][id] = send;
+    }
+    sync_wake(e, NO_NODE);
+  }
+  bits->valid = false;
+  bits->checked = false;
+}
+
+Result bitslice_beat(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  Bitslice* bits = &e->bits;
+
+  if (bits->valid && bits->generation != index->generation) {
+    bitslice_flush(e);
+  }
+  if (!bits->valid) {
+    if (bits->checked && bits->generation == index->generation) {
+      return Err;
+    }
+    bits->generation = index->generation;
+    if (bitslice_pack(e) != Ok) {
+      bits->checked = true;
+      return Err;
+    }
+  }
+
+  u64* value = bits->value[bits->current];
+  u64* next = bits->value[!bits->current];
+  u64** sent = bits->send[bits->current];
+  u64** send = bits->send[!bits->current];
+  const u32 last = bits->words - 1;
+  const u32 stride = bits->stride;
+
+  for (u32 w = 0; w < bits->words; ++w) {
+    // what arrives from each direction, and the sender's value
+    u64 in[MAX_DIR];
+    u64 in_value[MAX_DIR];
+    in[DIR_LEFT]  = (sent[DIR_RIGHT][w] << 1) | (w > 0 ? sent[DIR_RIGHT][w - 1] >> 63 : 0);
+    in[DIR_RIGHT] = (sent[DIR_LEFT][w] >> 1) | (w < last ? sent[DIR_LEFT][w + 1] << 63 : 0);
+    in[DIR_UP]    = w >= stride ? sent[DIR_DOWN][w - stride] : 0;
+    in[DIR_DOWN]  = w + stride <= last ? sent[DIR_UP][w + stride] : 0;
+    in_value[DIR_LEFT]  = (value[w] << 1) | (w > 0 ? value[w - 1] >> 63 : 0);
+    in_value[DIR_RIGHT] = (value[w] >> 1) | (w < last ? value[w + 1] << 63 : 0);
+    in_value[DIR_UP]    = w >= stride ? value[w - stride] : 0;
+    in_value[DIR_DOWN]  = w + stride <= last ? value[w + stride] : 0;
+
+    u64 v = value[w];
+    u64 listen[MAX_DIR];
+    u64 any = 0;
+    u64 two = 0;
+    u64 first = 0;
+    u64 second = 0;
+    u64 latest = 0;
+    for (u32 d = 0; d < MAX_DIR; ++d) {
+      in[d] &= bits->neighbour[d][w] & bits->alive[w];
+      u64 copied = in[d] & bits->neighbour_copy[d][w];
+      v = (v & ~copied) | (in_value[d] & copied);
+      listen[d] = in[d] & bits->listen[d][w];
+      first |= listen[d] & ~any & in_value[d];
+      second |= listen[d] & any & ~two & in_value[d];
+      latest = (latest & ~listen[d]) | (listen[d] & in_value[d]);
+      two |= any & listen[d];
+      any |= listen[d];
+    }
+
+    u64 n = v;
+    n = (n & ~(bits->gate_and[w] & two)) | (bits->gate_and[w] & two & first & second);
+    n = (n & ~(bits->gate_equals[w] & two)) | (bits->gate_equals[w] & two & ~(first ^ second));
+    n = (n & ~(bits->gate_not[w] & any)) | (bits->gate_not[w] & any & ~first);
+    n = (n & ~(bits->copy[w] & any)) | (bits->copy[w] & any & first);
+    n = (n & ~(bits->print[w] & any)) | (bits->print[w] & any & latest);
+    n = (n & bits->alive[w]) | (value[w] & ~bits->alive[w]);
+    next[w] = n;
+
+    u64 fire = ((bits->bus[w] | bits->gate_not[w] | bits->copy[w]) & any) |
+      ((bits->gate_and[w] | bits->gate_equals[w]) & two & n);
+    u64 sends = 0;
+    for (u32 d = 0; d < MAX_DIR; ++d) {
+      send[d][w] = (fire & bits->broadcast[w] & bits->neighbour[d][w] & ~listen[d]) | (fire & bits->out[d][w]);
+      sends |= send[d][w];
+    }
+
+    // write back what changed, most of a row usually doesn't
+    for (u64 changed = n ^ value[w]; changed; changed &= changed - 1) {
+      u32 bit = __builtin_ctzll(changed);
+      nodes->data[w * BITSLICE_WORD_BITS + bit].value = (n >> bit) & 1;
+    }
+    for (u64 green = any & ~sends; green; green &= green - 1) {
+      e->node_colors[w * BITSLICE_WORD_BITS + __builtin_ctzll(green)] = colors[COLOR_GREEN];
+    }
+    for (u64 red = sends; red; red &= red - 1) {
+      e->node_colors[w * BITSLICE_WORD_BITS + __builtin_ctzll(red)] = colors[COLOR_RED];
+    }
+    for (u64 print = bits->print[w] & any; print; print &= print - 1) {
+      bitslice_print(e, w * BITSLICE_WORD_BITS + __builtin_ctzll(print), value, listen);
+    }
+    e->event_count += __builtin_popcountll(any | fire);
+  }
+  bits->current = !bits->current;
+  return Ok;
+}
+
+// prints in the order sync_simulate_beat would, one line per input with the
+// value it had on the previous beat
+void bitslice_print(Engine* e, u32 id, u64* value, u64 listen[MAX_DIR]) {
+  Nodes* nodes = &e->state.nodes;
+  u32 shift = id % BITSLICE_WORD_BITS;
+  for (u32 d = 0; d < MAX_DIR; ++d) {
+    if ((listen[d] >> shift) & 1) {
+      u32 input = e->graph.dir[id][d];
+      u16 v = (value[input / BITSLICE_WORD_BITS] >> (input % BITSLICE_WORD_BITS)) & 1;
+      signal_engine_log(e, "node", "%s: %u", node_type_str[nodes->type[input]], v);
+      log_info("%s: %u\n", node_type_str[nodes->type[input]], v);
+    }
+  }
+}
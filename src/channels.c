@@ -0,0 +1,74 @@
+// channels.c
+
+static int channels_order(const void* a, const void* b);
+
+void channels_alloc(Engine* e, Arena* arena) {
+  Channels* channels = &e->channels;
+  u32 max_node = e->state.nodes.max_node;
+  channels->channels = arena_alloc(arena, sizeof(Channel) * max_node);
+  channels->members = arena_alloc(arena, sizeof(u32) * max_node);
+  channels->group = arena_alloc(arena, sizeof(u32) * max_node);
+  channels->keys = arena_alloc(arena, sizeof(Channel_key) * max_node);
+  channels->channel_count = 0;
+  channels->valid = false;
+}
+
+void channels_update(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  Channels* channels = &e->channels;
+  if (channels->valid && channels->generation == index->generation) {
+    return;
+  }
+  u32 count = index->channel_node_count;
+  for (u32 i = 0; i < count; ++i) {
+    u32 id = index->channel_nodes[i];
+    channels->keys[i] = (Channel_key) {
+      .channel = nodes->channel[id],
+      .type = nodes->type[id],
+      .node = id,
+    };
+  }
+  // SEND comes before RECEIVE in the node types
+  if (count > 0) {
+    qsort(channels->keys, count, sizeof(Channel_key), channels_order);
+  }
+  channels->channel_count = 0;
+  Channel* channel = NULL;
+  for (u32 i = 0; i < count; ++i) {
+    Channel_key* key = &channels->keys[i];
+    if (!channel || channel->id != key->channel) {
+      channel = &channels->channels[channels->channel_count++];
+      *channel = (Channel) {
+        .id = key->channel,
+        .first = i,
+      };
+    }
+    channels->members[i] = key->node;
+    channels->group[key->node] = channels->channel_count - 1;
+    if (key->type == NODE_SEND) {
+      channel->send_count++;
+    }
+    else {
+      channel->receive_count++;
+    }
+  }
+  channels->generation = index->generation;
+  channels->valid = true;
+}
+
+Channel* channels_of(Engine* e, u32 id) {
+  return &e->channels.channels[e->channels.group[id]];
+}
+
+int channels_order(const void* a, const void* b) {
+  const Channel_key* x = a;
+  const Channel_key* y = b;
+  if (x->channel != y->channel) {
+    return x->channel < y->channel ? -1 : 1;
+  }
+  if (x->type != y->type) {
+    return x->type < y->type ? -1 : 1;
+  }
+  return x->node < y->node ? -1 : x->node > y->node;
+}
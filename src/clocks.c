@@ -0,0 +1,183 @@
+// clocks.c
+
+static void clocks_rebuild(Engine* e);
+static u64 clocks_next(u32 period, u32 phase, u64 from);
+static void clocks_push(Clocks* clocks, Clock_entry entry);
+static Clock_entry clocks_pop(Clocks* clocks);
+static int clocks_order(const void* a, const void* b);
+
+void clocks_alloc(Engine* e, Arena* arena) {
+  Clocks* clocks = &e->clocks;
+  u32 max_node = e->state.nodes.max_node;
+  clocks->heap = arena_alloc(arena, sizeof(Clock_entry) * max_node);
+  clocks->every = arena_alloc(arena, sizeof(u32) * max_node);
+  clocks->popped = arena_alloc(arena, sizeof(u32) * max_node);
+  clocks->merged = arena_alloc(arena, sizeof(u32) * max_node);
+  clocks->fires = arena_alloc(arena, sizeof(u8) * max_node);
+  clocks->wait = arena_alloc(arena, sizeof(u64) * max_node);
+  if (clocks->fires) {
+    memset(clocks->fires, 0, sizeof(u8) * max_node);
+  }
+  clocks->heap_count = 0;
+  clocks->every_count = 0;
+  clocks->popped_count = 0;
+  clocks->due = clocks->every;
+  clocks->due_count = 0;
+  clocks->valid = false;
+}
+
+void clocks_touch(Engine* e) {
+  e->clocks.valid = false;
+}
+
+void clocks_reset(Engine* e) {
+  e->clocks.now = 0;
+  e->clocks.valid = false;
+}
+
+void clocks_advance(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Clocks* clocks = &e->clocks;
+  clocks->now++;
+  for (u32 i = 0; i < clocks->popped_count; ++i) {
+    clocks->fires[clocks->popped[i]] = false;
+  }
+  clocks->popped_count = 0;
+  if (!clocks->valid || clocks->generation != e->index.generation) {
+    clocks_rebuild(e);
+  }
+  while (clocks->heap_count > 0 && clocks->heap[0].due == clocks->now) {
+    Clock_entry entry = clocks_pop(clocks);
+    clocks->popped[clocks->popped_count++] = entry.node;
+    clocks->fires[entry.node] = true;
+    entry.due += nodes->period[entry.node];
+    clocks_push(clocks, entry);
+  }
+  if (clocks->popped_count == 0) {
+    clocks->due = clocks->every;
+    clocks->due_count = clocks->every_count;
+    return;
+  }
+  // both in id order, so they fire in the order they always have
+  qsort(clocks->popped, clocks->popped_count, sizeof(u32), clocks_order);
+  u32 a = 0;
+  u32 b = 0;
+  u32 count = 0;
+  while (a < clocks->every_count || b < clocks->popped_count) {
+    if (b == clocks->popped_count || (a < clocks->every_count && clocks->every[a] < clocks->popped[b])) {
+      clocks->merged[count++] = clocks->every[a++];
+    }
+    else {
+      clocks->merged[count++] = clocks->popped[b++];
+    }
+  }
+  clocks->due = clocks->merged;
+  clocks->due_count = count;
+}
+
+void clocks_skip(Engine* e, u64 beats) {
+  e->clocks.now += beats;
+  e->clocks.valid = false;
+}
+
+u32 clocks_uniform(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  for (u32 i = 0; i < index->clock_count; ++i) {
+    if (nodes->period[index->clocks[i]] > 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void clocks_pending(Engine* e, u64** wait, u64* size) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  Clocks* clocks = &e->clocks;
+  u32 count = 0;
+  for (u32 i = 0; i < index->clock_count; ++i) {
+    u32 id = index->clocks[i];
+    if (nodes->period[id] > 1) {
+      clocks->wait[count++] = clocks_next(nodes->period[id], nodes->phase[id], clocks->now + 1) - clocks->now;
+    }
+  }
+  *wait = clocks->wait;
+  *size = sizeof(u64) * count;
+}
+
+// the schedule only depends on the beat number, so it can be built from scratch
+void clocks_rebuild(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  Clocks* clocks = &e->clocks;
+  for (u32 i = 0; i < clocks->every_count; ++i) {
+    clocks->fires[clocks->every[i]] = false;
+  }
+  clocks->every_count = 0;
+  clocks->heap_count = 0;
+  for (u32 i = 0; i < index->clock_count; ++i) {
+    u32 id = index->clocks[i];
+    if (nodes->period[id] <= 1) {
+      clocks->every[clocks->every_count++] = id;
+      clocks->fires[id] = true;
+      continue;
+    }
+    clocks_push(clocks, (Clock_entry) {
+      .due = clocks_next(nodes->period[id], nodes->phase[id], clocks->now),
+      .node = id,
+    });
+  }
+  clocks->generation = e->index.generation;
+  clocks->valid = true;
+}
+
+// the first beat from on that is the phase modulo the period
+u64 clocks_next(u32 period, u32 phase, u64 from) {
+  u64 offset = (phase % period + period - from % period) % period;
+  return from + offset;
+}
+
+void clocks_push(Clocks* clocks, Clock_entry entry) {
+  u32 i = clocks->heap_count++;
+  while (i > 0) {
+    u32 parent = (i - 1) / 2;
+    if (clocks->heap[parent].due <= entry.due) {
+      break;
+    }
+    clocks->heap[i] = clocks->heap[parent];
+    i = parent;
+  }
+  clocks->heap[i] = entry;
+}
+
+Clock_entry clocks_pop(Clocks* clocks) {
+  Clock_entry top = clocks->heap[0];
+  Clock_entry last = clocks->heap[--clocks->heap_count];
+  u32 count = clocks->heap_count;
+  u32 i = 0;
+  for (;;) {
+    u32 child = 2 * i + 1;
+    if (child >= count) {
+      break;
+    }
+    if (child + 1 < count && clocks->heap[child + 1].due < clocks->heap[child].due) {
+      ++child;
+    }
+    if (last.due <= clocks->heap[child].due) {
+      break;
+    }
+    clocks->heap[i] = clocks->heap[child];
+    i = child;
+  }
+  if (count > 0) {
+    clocks->heap[i] = last;
+  }
+  return top;
+}
+
+int clocks_order(const void* a, const void* b) {
+  u32 x = *(const u32*)a;
+  u32 y = *(const u32*)b;
+  return x < y ? -1 : x > y;
+}
@@ -0,0 +1,497 @@
+// codegen.c
+// generates a C translation unit specialised for one circuit, with a function
+// per node that has its type, neighbours and read count baked in, builds it
+// with the system compiler in the background and loads it as the beat kernel
+
+#include <dlfcn.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define KERNEL_SOURCE "kernel.c"
+#define KERNEL_OBJECT "kernel.so"
+#define KERNEL_BEAT "signal_kernel_beat"
+#define MAX_COMMAND_SIZE (4 * MAX_PATH_SIZE)
+// generous for a node function, half the stack is kept for the rest
+#define KERNEL_FRAME_SIZE 128
+#define DEFAULT_STACK_SIZE (8 * 1024 * 1024)
+
+static const char* kernel_prelude =
+  "#include <stdint.h>\n"
+  "\n"
+  "#define NO_NODE ((uint32_t)-1)\n"
+  "\n"
+  "typedef struct {\n"
+  "  " NODE_VALUE_C_TYPE "* value;\n"
+  "  uint8_t* reads;\n"
+  "  uint8_t* writes;\n"
+  "  uint8_t* ready;\n"
+  "  uint32_t* node_colors;\n"
+  "  uint64_t* event_count;\n"
+  "  uint32_t* not_ready;\n"
+  "  uint32_t* not_ready_count;\n"
+  "  uint8_t* not_ready_listed;\n"
+  "  uint8_t* fires;\n"
+  "  void (*print)(void* user, uint32_t input, uint32_t self);\n"
+  "  void* user;\n"
+  "} Kernel_context;\n"
+  "\n"
+  "static inline void finalize(Kernel_context* c, uint32_t self, uint8_t reads) {\n"
+  "  if (c->reads[self] >= reads || c->writes[self] >= %u) {\n"
+  "    c->ready[self] = 0;\n"
+  "    if (!c->not_ready_listed[self]) {\n"
+  "      c->not_ready_listed[self] = 1;\n"
+  "      c->not_ready[(*c->not_ready_count)++] = self;\n"
+  "    }\n"
+  "  }\n"
+  "}\n"
+  "\n";
+
+static Result codegen_start(Engine* e);
+static void codegen_finish(Engine* e, u32 wait);
+static u32 codegen_depth(Engine* e);
+static Result codegen_emit(Engine* e, FILE* fp);
+static void codegen_emit_node(Engine* e, FILE* fp, Instruction* ins);
+static void codegen_emit_read(FILE* fp, u32 self, const char* indent);
+static void codegen_emit_send(Engine* e, FILE* fp, u32 self, u32 target, u32 copy, const char* indent);
+static void codegen_emit_broadcast(Engine* e, FILE* fp, Instruction* ins, const char* indent);
+static void codegen_print(void* user, u32 input, u32 self);
+
+Result codegen_build(Engine* e) {
+  if (codegen_start(e) != Ok) {
+    return Err;
+  }
+  codegen_finish(e, true);
+  return e->native.beat ? Ok : Err;
+}
+
+// emit the source of the current circuit and start the compiler on it, the
+// kernel is loaded by codegen_finish
+Result codegen_start(Engine* e) {
+  Result result = Ok;
+  Native_kernel* native = &e->native;
+  FILE* fp = NULL;
+  char source[MAX_COMMAND_SIZE] = {0};
+  char object[MAX_COMMAND_SIZE] = {0};
+  char command[MAX_COMMAND_SIZE] = {0};
+
+  codegen_unload(e);
+  netlist_update(e);
+  native->generation = e->index.generation;
+  native->built = true;
+  native->prune = e->prune;
+  if (e->prune) {
+    analysis_update(e);
+  }
+  if (e->netlist.delay_count > 0) {
+    log_error("the native kernel can't hold values in DELAY nodes\n");
+    return_defer(Err);
+  }
+  if (e->netlist.memory_count > 0) {
+    log_error("the native kernel can't reach the banks of MEMORY nodes\n");
+    return_defer(Err);
+  }
+  if (e->netlist.macro_count > 0) {
+    log_error("the native kernel can't run the bodies of MACRO nodes\n");
+    return_defer(Err);
+  }
+
+  struct rlimit stack = {0};
+  u64 stack_size = DEFAULT_STACK_SIZE;
+  if (getrlimit(RLIMIT_STACK, &stack) == 0 && stack.rlim_cur != RLIM_INFINITY) {
+    stack_size = stack.rlim_cur;
+  }
+  if ((u64)codegen_depth(e) * KERNEL_FRAME_SIZE > stack_size / 2) {
+    log_error("the cascades of this circuit can nest deeper than the stack allows\n");
+    return_defer(Err);
+  }
+
+  if (native->dir[0] == 0) {
+    snprintf(native->dir, MAX_PATH_SIZE, "/tmp/signal_engine_XXXXXX");
+    if (!mkdtemp(native->dir)) {
+      log_error("failed to create kernel directory\n");
+      native->dir[0] = 0;
+      return_defer(Err);
+    }
+  }
+  snprintf(source, MAX_COMMAND_SIZE, "%s/%s", native->dir, KERNEL_SOURCE);
+  snprintf(object, MAX_COMMAND_SIZE, "%s/%s", native->dir, KERNEL_OBJECT);
+
+  fp = fopen(source, "w");
+  if (!fp) {
+    log_error("failed to open `%s` for writing\n", source);
+    return_defer(Err);
+  }
+  if (codegen_emit(e, fp) != Ok) {
+    log_error("failed to write kernel source\n");
+    return_defer(Err);
+  }
+  fclose(fp);
+  fp = NULL;
+
+  const char* cc = getenv("CC");
+  if (!cc || cc[0] == 0) {
+    cc = "cc";
+  }
+  // at -O2 the compiler inlines the cascades into each other and the build time
+  // grows much faster than the circuit
+  snprintf(command, MAX_COMMAND_SIZE, "exec %s -O1 -shared -fPIC -o %s %s", cc, object, source);
+  pid_t pid = fork();
+  if (pid < 0) {
+    log_error("failed to start the compiler: %s\n", command);
+    return_defer(Err);
+  }
+  if (pid == 0) {
+    // a group of its own, so unloading stops the compiler and what it runs
+    setpgid(0, 0);
+    execl("/bin/sh", "sh", "-c", command, (char*)NULL);
+    _exit(127);
+  }
+  setpgid(pid, pid);
+  native->pid = pid;
+defer:
+  if (fp) {
+    fclose(fp);
+  }
+  return result;
+}
+
+// load the kernel once the compiler exited, unless the circuit was edited while
+// it ran. without wait it returns right away while the compiler still runs
+void codegen_finish(Engine* e, u32 wait) {
+  Native_kernel* native = &e->native;
+  char object[MAX_COMMAND_SIZE] = {0};
+  i32 status = 0;
+  pid_t done = waitpid(native->pid, &status, wait ? 0 : WNOHANG);
+  if (done == 0) {
+    return;
+  }
+  native->pid = 0;
+  if (done < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    log_error("failed to compile kernel\n");
+    signal_engine_log(e, "error", "native kernel unavailable, using vm");
+    return;
+  }
+  if (native->generation != e->index.generation || native->prune != e->prune) {
+    return;
+  }
+
+  snprintf(object, MAX_COMMAND_SIZE, "%s/%s", native->dir, KERNEL_OBJECT);
+  native->handle = dlopen(object, RTLD_NOW | RTLD_LOCAL);
+  if (!native->handle) {
+    log_error("failed to load kernel: %s\n", dlerror());
+    return;
+  }
+  native->beat = (kernel_beat)dlsym(native->handle, KERNEL_BEAT);
+  if (!native->beat) {
+    log_error("kernel is missing `%s`\n", KERNEL_BEAT);
+    dlclose(native->handle);
+    native->handle = NULL;
+    return;
+  }
+  signal_engine_log(e, "info", "built native kernel for %u nodes", e->netlist.count);
+}
+
+// how many node functions can be on the stack at once. a node is entered again
+// while it sends only as long as it has reads and writes left
+u32 codegen_depth(Engine* e) {
+  Netlist* netlist = &e->netlist;
+  u32 depth = 0;
+  for (u32 i = 0; i < netlist->count; ++i) {
+    Instruction* ins = &netlist->program[i];
+    depth += ins->reads > 0 ? MIN(ins->reads, MAX_WRITES) : MAX_WRITES;
+  }
+  return depth;
+}
+
+void codegen_unload(Engine* e) {
+  Native_kernel* native = &e->native;
+  if (native->pid > 0) {
+    kill(-native->pid, SIGKILL);
+    waitpid(native->pid, NULL, 0);
+  }
+  native->pid = 0;
+  if (native->handle) {
+    dlclose(native->handle);
+  }
+  native->handle = NULL;
+  native->beat = NULL;
+  native->built = false;
+  if (native->dir[0] != 0) {
+    char path[MAX_COMMAND_SIZE] = {0};
+    snprintf(path, MAX_COMMAND_SIZE, "%s/%s", native->dir, KERNEL_SOURCE);
+    remove(path);
+    snprintf(path, MAX_COMMAND_SIZE, "%s/%s", native->dir, KERNEL_OBJECT);
+    remove(path);
+    rmdir(native->dir);
+    native->dir[0] = 0;
+  }
+}
+
+void codegen_trigger_clocks(Engine* e) {
+  Native_kernel* native = &e->native;
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+
+  if (native->pid > 0) {
+    codegen_finish(e, false);
+  }
+  // a build of an older circuit is let finish before the next one starts
+  if (native->pid == 0 && (!native->built || native->generation != index->generation || native->prune != e->prune)) {
+    if (codegen_start(e) != Ok) {
+      signal_engine_log(e, "error", "native kernel unavailable, using vm");
+    }
+  }
+  if (!native->beat) {
+    netlist_trigger_clocks(e);
+    return;
+  }
+
+  // Node_data is a single Node_value, so the values can be handed over as a plain array
+  Kernel_context c = {
+    .value = &nodes->data[0].value,
+    .reads = nodes->reads,
+    .writes = nodes->writes,
+    .ready = nodes->ready,
+    .node_colors = e->node_colors,
+    .event_count = &e->event_count,
+    .not_ready = index->not_ready,
+    .not_ready_count = &index->not_ready_count,
+    .not_ready_listed = index->not_ready_listed,
+    .fires = e->clocks.fires,
+    .print = codegen_print,
+    .user = e,
+  };
+  native->beat(&c);
+}
+
+Result codegen_emit(Engine* e, FILE* fp) {
+  Netlist* netlist = &e->netlist;
+
+  fprintf(fp, kernel_prelude, MAX_WRITES);
+  for (u32 i = 0; i < netlist->count; ++i) {
+    fprintf(fp, "static void n%u(Kernel_context* c, uint32_t input);\n", netlist->program[i].node);
+  }
+  fprintf(fp, "\n");
+  for (u32 i = 0; i < netlist->count; ++i) {
+    codegen_emit_node(e, fp, &netlist->program[i]);
+  }
+
+  // clocks fire in id order, which is the order the netlist lists them in. the
+  // periods can change without an edit, so which ones are due is read each beat
+  fprintf(fp, "void %s(Kernel_context* c) {\n", KERNEL_BEAT);
+  for (u32 i = 0; i < netlist->clock_count; ++i) {
+    u32 id = netlist->program[netlist->clocks[i]].node;
+    if (e->prune && !e->analysis.live[id]) {
+      continue;
+    }
+    fprintf(fp, "  if (c->fires[%u]) {\n", id);
+    fprintf(fp, "    c->ready[%u] = 1;\n", id);
+    fprintf(fp, "    n%u(c, NO_NODE);\n", id);
+    fprintf(fp, "  }\n");
+  }
+  fprintf(fp, "}\n");
+  return ferror(fp) ? Err : Ok;
+}
+
+// same rules as netlist_dispatch, with the switch on the opcode resolved at
+// generation time. the sends recurse directly into the target's function so
+// the depth-first order of the cascade falls out of the call stack
+void codegen_emit_node(Engine* e, FILE* fp, Instruction* ins) {
+  Instruction* program = e->netlist.program;
+  u32 self = ins->node;
+
+  fprintf(fp, "static void n%u(Kernel_context* c, uint32_t input) {\n", self);
+  fprintf(fp, "  if (!c->ready[%u]) {\n    return;\n  }\n", self);
+  if (ins->reads == 0) {
+    fprintf(fp, "  input = NO_NODE;\n");
+  }
+  else {
+    fprintf(fp, "  if (c->reads[%u] >= %u) {\n    return;\n  }\n", self, ins->reads);
+  }
+  fprintf(fp, "  if (c->writes[%u] >= %u) {\n    return;\n  }\n", self, MAX_WRITES);
+  fprintf(fp, "  ++*c->event_count;\n");
+
+  switch (ins->op) {
+    case NODE_NONE: {
+      codegen_emit_read(fp, self, "  ");
+      break;
+    }
+    case NODE_CLOCK: {
+      fprintf(fp, "  c->value[%u] += 1;\n", self);
+      codegen_emit_broadcast(e, fp, ins, "  ");
+      break;
+    }
+    case NODE_ADD: {
+      fprintf(fp, "  if (input != NO_NODE) {\n");
+      codegen_emit_read(fp, self, "    ");
+      fprintf(fp, "    uint8_t reads = c->reads[%u];\n", self);
+      fprintf(fp, "    c->value[%u] += c->value[input];\n", self);
+      fprintf(fp, "    if (reads == 2) {\n");
+      codegen_emit_broadcast(e, fp, ins, "      ");
+      fprintf(fp, "    }\n");
+      fprintf(fp, "  }\n");
+      break;
+    }
+    case NODE_BUS: {
+      fprintf(fp, "  if (input != NO_NODE) {\n");
+      codegen_emit_read(fp, self, "    ");
+      fprintf(fp, "  }\n");
+      codegen_emit_broadcast(e, fp, ins, "  ");
+      break;
+    }
+    case NODE_AND:
+    case NODE_EQUALS: {
+      fprintf(fp, "  if (input != NO_NODE) {\n");
+      codegen_emit_read(fp, self, "    ");
+      fprintf(fp, "    uint8_t reads = c->reads[%u];\n", self);
+      fprintf(fp, "    if (reads == 1) {\n");
+      fprintf(fp, "      c->value[%u] = c->value[input];\n", self);
+      fprintf(fp, "    }\n");
+      fprintf(fp, "    else {\n");
+      if (ins->op == NODE_AND) {
+        fprintf(fp, "      c->value[%u] = c->value[%u] && c->value[input];\n", self, self);
+      }
+      else {
+        fprintf(fp, "      c->value[%u] = c->value[%u] == c->value[input];\n", self, self);
+      }
+      fprintf(fp, "      if (c->value[%u] != 0) {\n", self);
+      codegen_emit_broadcast(e, fp, ins, "        ");
+      fprintf(fp, "      }\n");
+      fprintf(fp, "    }\n");
+      fprintf(fp, "  }\n");
+      break;
+    }
+    case NODE_PRINT: {
+      fprintf(fp, "  if (input != NO_NODE) {\n");
+      codegen_emit_read(fp, self, "    ");
+      fprintf(fp, "    c->value[%u] = c->value[input];\n", self);
+      fprintf(fp, "    c->print(c->user, input, %u);\n", self);
+      fprintf(fp, "  }\n");
+      break;
+    }
+    case NODE_INCR:
+    case NODE_NOT:
+    case NODE_COPY: {
+      fprintf(fp, "  if (input != NO_NODE) {\n");
+      codegen_emit_read(fp, self, "    ");
+      if (ins->op == NODE_INCR) {
+        fprintf(fp, "    c->value[%u] += c->value[input];\n", self);
+      }
+      else if (ins->op == NODE_NOT) {
+        fprintf(fp, "    c->value[%u] = !c->value[input];\n", self);
+      }
+      else {
+        fprintf(fp, "    c->value[%u] = c->value[input];\n", self);
+      }
+      codegen_emit_broadcast(e, fp, ins, "    ");
+      fprintf(fp, "  }\n");
+      break;
+    }
+    case NODE_COPY_LR:
+    case NODE_COPY_RL:
+    case NODE_COPY_UD:
+    case NODE_COPY_DU: {
+      // only reads from the neighbour on its input side, so with none there it never reads
+      if (ins->in != NO_NODE) {
+        fprintf(fp, "  if (input == %u) {\n", program[ins->in].node);
+        codegen_emit_read(fp, self, "    ");
+        fprintf(fp, "    c->value[%u] = c->value[input];\n", self);
+        if (ins->out != NO_NODE) {
+          codegen_emit_send(e, fp, self, program[ins->out].node, true, "    ");
+        }
+        fprintf(fp, "  }\n");
+      }
+      break;
+    }
+    case NODE_SEND: {
+      Nodes* nodes = &e->state.nodes;
+      Channels* channels = &e->channels;
+      Channel* channel = channels_of(e, self);
+      fprintf(fp, "  if (input != NO_NODE) {\n");
+      codegen_emit_read(fp, self, "    ");
+      fprintf(fp, "    c->value[%u] = c->value[input];\n", self);
+      fprintf(fp, "  }\n");
+      // the whole channel costs one write
+      fprintf(fp, "  c->writes[%u]++;\n", self);
+      fprintf(fp, "  c->node_colors[%u] = 0x%xu;\n", self, colors[COLOR_RED]);
+      for (u32 i = 0; i < channel->receive_count; ++i) {
+        u32 target = channels->members[channel->first + channel->send_count + i];
+        assert(nodes->type[target] == NODE_RECEIVE);
+        if (e->prune && !e->analysis.live[target]) {
+          continue;
+        }
+        fprintf(fp, "  c->value[%u] = c->value[%u];\n", target, self);
+        fprintf(fp, "  n%u(c, %u);\n", target, self);
+      }
+      break;
+    }
+    case NODE_RECEIVE: {
+      // anything but a SEND that writes to it is a neighbour, which it ignores
+      Nodes* nodes = &e->state.nodes;
+      u32 ignored = 0;
+      fprintf(fp, "  if (");
+      for (u32 i = 0; i < ins->count; ++i) {
+        u32 target = program[ins->targets[i]].node;
+        if (nodes->type[target] != NODE_SEND) {
+          fprintf(fp, "%sinput != %u", ignored++ ? " && " : "", target);
+        }
+      }
+      fprintf(fp, "%s) {\n", ignored ? "" : "1");
+      fprintf(fp, "    if (input != NO_NODE) {\n");
+      codegen_emit_read(fp, self, "      ");
+      fprintf(fp, "    }\n");
+      codegen_emit_broadcast(e, fp, ins, "    ");
+      fprintf(fp, "  }\n");
+      break;
+    }
+    default:
+      assert(0);
+      break;
+  }
+  fprintf(fp, "  finalize(c, %u, %u);\n", self, ins->reads);
+  fprintf(fp, "}\n\n");
+}
+
+void codegen_emit_read(FILE* fp, u32 self, const char* indent) {
+  fprintf(fp, "%sc->reads[%u]++;\n", indent, self);
+  fprintf(fp, "%sc->node_colors[%u] = 0x%xu;\n", indent, self, colors[COLOR_GREEN]);
+}
+
+void codegen_emit_send(Engine* e, FILE* fp, u32 self, u32 target, u32 copy, const char* indent) {
+  fprintf(fp, "%sc->writes[%u]++;\n", indent, self);
+  fprintf(fp, "%sc->node_colors[%u] = 0x%xu;\n", indent, self, colors[COLOR_RED]);
+  if (e->prune && !e->analysis.live[target]) {
+    return;
+  }
+  if (copy) {
+    fprintf(fp, "%sc->value[%u] = c->value[%u];\n", indent, target, self);
+  }
+  fprintf(fp, "%sn%u(c, %u);\n", indent, target, self);
+}
+
+void codegen_emit_broadcast(Engine* e, FILE* fp, Instruction* ins, const char* indent) {
+  Instruction* program = e->netlist.program;
+  u32 copy = ins->op == NODE_COPY;
+  for (u32 i = 0; i < ins->count; ++i) {
+    u32 target = program[ins->targets[i]].node;
+    if (ins->reads == 0 || ins->op == NODE_RECEIVE) {
+      // nothing to loop back to when there is no input, or it came from a channel
+      codegen_emit_send(e, fp, ins->node, target, copy, indent);
+      continue;
+    }
+    char inner[32] = {0};
+    snprintf(inner, sizeof(inner), "%s  ", indent);
+    fprintf(fp, "%sif (input != %u) {\n", indent, target);
+    codegen_emit_send(e, fp, ins->node, target, copy, inner);
+    fprintf(fp, "%s}\n", indent);
+  }
+}
+
+void codegen_print(void* user, u32 input, u32 self) {
+  Engine* e = (Engine*)user;
+  Nodes* nodes = &e->state.nodes;
+  signal_engine_log(e, "node", "%s: " NODE_VALUE_FMT, node_type_str[nodes->type[input]], nodes->data[self].value);
+  log_info("%s: " NODE_VALUE_FMT "\n", node_type_str[nodes->type[input]], nodes->data[self].value);
+}
@@ -1,5 +1,9 @@
 // common.c
 
+#include <sys/mman.h>
+
+#define ARENA_ALIGN 64
+
 void buffer_init(Buffer* buffer) {
   assert(buffer);
   buffer->data = NULL;
@@ -25,6 +29,18 @@ void buffer_free(Buffer* buffer) {
   }
 }
 
+void buffer_append(Buffer* buffer, const void* data, u32 size) {
+  assert(buffer);
+  u8* grown = realloc(buffer->data, buffer->size + size);
+  if (!grown) {
+    assert(!"buffer_append: failed to allocate memory");
+    return;
+  }
+  buffer->data = grown;
+  memcpy(&buffer->data[buffer->size], data, size);
+  buffer->size += size;
+}
+
 u32 buffer_iterate(void* restrict dest, Buffer* source, u32 size, u32* iter) {
   assert("buffer_iterate: write outside buffer memory area" && (*iter + size) <= source->size);
   memcpy(dest, &source->data[*iter], size);
@@ -34,6 +50,43 @@ u32 buffer_iterate(void* restrict dest, Buffer* source, u32 size, u32* iter) {
   return size;
 }
 
+Result arena_init(Arena* arena, u64 size, u32 huge_pages) {
+  arena->used = 0;
+  arena->size = size > 0 ? size : 1;
+  arena->data = mmap(NULL, arena->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (arena->data == MAP_FAILED) {
+    log_error("arena_init: failed to reserve %lu bytes\n", (unsigned long)size);
+    arena->data = NULL;
+    arena->size = 0;
+    return Err;
+  }
+#ifdef MADV_HUGEPAGE
+  if (huge_pages && madvise(arena->data, arena->size, MADV_HUGEPAGE) != 0) {
+    log_info("arena_init: huge pages are not available, using normal pages\n");
+  }
+#endif
+  return Ok;
+}
+
+void* arena_alloc(Arena* arena, u64 size) {
+  u64 offset = (arena->used + ARENA_ALIGN - 1) & ~(u64)(ARENA_ALIGN - 1);
+  arena->used = offset + size;
+  if (!arena->data) {
+    return NULL;
+  }
+  assert("arena_alloc: out of memory" && arena->used <= arena->size);
+  return &arena->data[offset];
+}
+
+void arena_free(Arena* arena) {
+  if (arena->data) {
+    munmap(arena->data, arena->size);
+  }
+  arena->data = NULL;
+  arena->size = 0;
+  arena->used = 0;
+}
+
 Result file_read(const char* path, Buffer* buffer) {
   Result result = Ok;
   u32 num_bytes_read = 0;
@@ -0,0 +1,229 @@
+// cycle.c
+// the state that decides what the next beat does is the node fields the engines
+// write, the signals in flight, what the DELAYs hold, how far each CLOCK is
+// into its period, the banks of the MEMORY nodes and the instances of the MACRO
+// nodes. colors, the event count
+// and prints only follow from it, so they are not part of a state
+
+#define MAX_CYCLE_REGION 13
+
+typedef struct {
+  void* data;
+  u64 size;
+} Cycle_region;
+
+typedef struct {
+  u64 hash;
+  u32 beat;
+  u32 used;
+} Cycle_entry;
+
+static Cycle_entry cycle_history[CYCLE_HISTORY];
+static u32 cycle_count = 0;
+static u8* cycle_snapshot = NULL;
+static u64 cycle_snapshot_size = 0;
+
+static u32 cycle_regions(Engine* e, Cycle_region* regions);
+static u64 cycle_hash(Cycle_region* regions, u32 count);
+static Result cycle_store(Cycle_region* regions, u32 count);
+static u32 cycle_compare(Cycle_region* regions, u32 count);
+static u32 cycle_insert(u64 hash, u32 beat, u32* first);
+
+u32 cycle_run(Engine* e, u32 beats) {
+  State* state = &e->state;
+  Cycle_region regions[MAX_CYCLE_REGION];
+  u32 simulated = 0;
+  u32 beat = 0;
+
+  memset(cycle_history, 0, sizeof(cycle_history));
+  cycle_count = 0;
+  u32 count = cycle_regions(e, regions);
+  u32 first = 0;
+  cycle_insert(cycle_hash(regions, count), beat, &first);
+
+  while (count > 0 && beat < beats) {
+    nodes_simulate_beat(e);
+    state->tick++;
+    ++beat;
+    ++simulated;
+
+    // the sends may have moved between the packed and the plain buffers
+    count = cycle_regions(e, regions);
+    if (count == 0) {
+      break;
+    }
+    if (!cycle_insert(cycle_hash(regions, count), beat, &first)) {
+      continue;
+    }
+    u32 period = beat - first;
+    if (beats - beat < 2 * period) {
+      continue; // nothing to gain
+    }
+
+    // a hash can collide, so run the period once more and compare exactly
+    if (cycle_store(regions, count) != Ok) {
+      break;
+    }
+    u64 event_count = e->event_count;
+    for (u32 i = 0; i < period; ++i) {
+      nodes_simulate_beat(e);
+    }
+    state->tick += period;
+    beat += period;
+    simulated += period;
+    count = cycle_regions(e, regions);
+    if (count == 0) {
+      break;
+    }
+    if (!cycle_compare(regions, count)) {
+      continue;
+    }
+    u32 cycles = (beats - beat) / period;
+    state->tick += cycles * period;
+    beat += cycles * period;
+    wheel_skip(e, (u64)cycles * period);
+    clocks_skip(e, (u64)cycles * period);
+    e->event_count += cycles * (e->event_count - event_count);
+    log_info("state repeats every %u beats from beat %u, skipped %u beats\n", period, first, cycles * period);
+    break;
+  }
+
+  for (; beat < beats; ++beat) {
+    nodes_simulate_beat(e);
+    state->tick++;
+    ++simulated;
+  }
+  return simulated;
+}
+
+// returns 0 when the state couldn't be gathered
+u32 cycle_regions(Engine* e, Cycle_region* regions) {
+  Nodes* nodes = &e->state.nodes;
+  u64 n = nodes->max_node;
+  u32 count = 0;
+  Wheel_pending* pending = NULL;
+  u64 pending_size = 0;
+  if (wheel_pending(e, &pending, &pending_size) != Ok) {
+    return 0;
+  }
+  if (pending_size > 0) {
+    regions[count++] = (Cycle_region) { pending, pending_size, };
+  }
+  u64* wait = NULL;
+  u64 wait_size = 0;
+  clocks_pending(e, &wait, &wait_size);
+  if (wait_size > 0) {
+    regions[count++] = (Cycle_region) { wait, wait_size, };
+  }
+  regions[count++] = (Cycle_region) { nodes->data, n * sizeof(*nodes->data), };
+  if (e->banks.count > 0) {
+    regions[count++] = (Cycle_region) { e->banks.banks, sizeof(Bank) * e->banks.count, };
+    regions[count++] = (Cycle_region) { e->banks.words, sizeof(Node_value) * BANK_WORDS * (u64)e->banks.count, };
+  }
+  if (e->subcircuits.count > 0) {
+    regions[count++] = (Cycle_region) { e->subcircuits.instances, sizeof(Instance) * e->subcircuits.count, };
+    regions[count++] = (Cycle_region) { e->subcircuits.values, sizeof(Node_value) * e->subcircuits.used, };
+  }
+  if (e->state.mode != SIM_MODE_CASCADE) {
+    if (e->state.mode == SIM_MODE_CHANGE) {
+      regions[count++] = (Cycle_region) { e->sync.latch, n * sizeof(*e->sync.latch), };
+      regions[count++] = (Cycle_region) { e->sync.latched, n, };
+      regions[count++] = (Cycle_region) { e->sync.emitted, n * sizeof(*e->sync.emitted), };
+      regions[count++] = (Cycle_region) { e->sync.has_emitted, n, };
+    }
+    if (e->bits.valid) {
+      // the directions of a side are consecutive rows of the bitslice block
+      regions[count++] = (Cycle_region) { e->bits.send[e->bits.current][0], MAX_DIR * e->bits.words * sizeof(u64), };
+    }
+    else {
+      regions[count++] = (Cycle_region) { e->sync.sends[e->sync.current], n, };
+    }
+  }
+  else {
+    regions[count++] = (Cycle_region) { nodes->reads, n, };
+    regions[count++] = (Cycle_region) { nodes->writes, n, };
+    regions[count++] = (Cycle_region) { nodes->ready, n, };
+    regions[count++] = (Cycle_region) { e->index.not_ready_listed, n, };
+  }
+  assert(count <= MAX_CYCLE_REGION);
+  return count;
+}
+
+// hashed in four independent streams of words so the multiplies don't wait on
+// each other, the bytes after the last four words go into the first stream
+u64 cycle_hash(Cycle_region* regions, u32 count) {
+  u64 hash[4] = { 0x9e3779b97f4a7c15ull, 0xbf58476d1ce4e5b9ull, 0x94d049bb133111ebull, 0x2545f4914f6cdd1dull, };
+  for (u32 r = 0; r < count; ++r) {
+    const u64* words = regions[r].data;
+    u64 whole = regions[r].size / (4 * sizeof(u64)) * 4;
+    for (u64 i = 0; i < whole; i += 4) {
+      for (u32 k = 0; k < 4; ++k) {
+        hash[k] = (hash[k] ^ words[i + k]) * 0xff51afd7ed558ccdull;
+        hash[k] ^= hash[k] >> 29;
+      }
+    }
+    const u8* tail = (const u8*)&words[whole];
+    for (u64 i = 0; i < regions[r].size - whole * sizeof(u64); ++i) {
+      hash[0] = (hash[0] ^ tail[i]) * 0xff51afd7ed558ccdull;
+    }
+  }
+  return hash[0] ^ (hash[1] * 3) ^ (hash[2] * 5) ^ (hash[3] * 7);
+}
+
+// the snapshot grows to the largest state seen and is kept between runs
+Result cycle_store(Cycle_region* regions, u32 count) {
+  u64 size = 0;
+  for (u32 r = 0; r < count; ++r) {
+    size += regions[r].size;
+  }
+  if (size > cycle_snapshot_size) {
+    u8* snapshot = realloc(cycle_snapshot, size);
+    if (!snapshot) {
+      log_error("cycle: failed to allocate a %lu byte snapshot\n", (unsigned long)size);
+      return Err;
+    }
+    cycle_snapshot = snapshot;
+    cycle_snapshot_size = size;
+  }
+  u64 offset = 0;
+  for (u32 r = 0; r < count; ++r) {
+    memcpy(&cycle_snapshot[offset], regions[r].data, regions[r].size);
+    offset += regions[r].size;
+  }
+  return Ok;
+}
+
+u32 cycle_compare(Cycle_region* regions, u32 count) {
+  u64 offset = 0;
+  for (u32 r = 0; r < count; ++r) {
+    if (memcmp(&cycle_snapshot[offset], regions[r].data, regions[r].size) != 0) {
+      return false;
+    }
+    offset += regions[r].size;
+  }
+  return true;
+}
+
+// returns true and the beat it was first seen on when the hash is already in the
+// history, otherwise remembers it. when the history fills up it starts over, so
+// periods up to half of it are still found
+u32 cycle_insert(u64 hash, u32 beat, u32* first) {
+  if (cycle_count >= CYCLE_HISTORY / 2) {
+    memset(cycle_history, 0, sizeof(cycle_history));
+    cycle_count = 0;
+  }
+  u32 slot = (u32)hash & (CYCLE_HISTORY - 1);
+  for (;;) {
+    Cycle_entry* entry = &cycle_history[slot];
+    if (!entry->used) {
+      *entry = (Cycle_entry) { .hash = hash, .beat = beat, .used = true, };
+      ++cycle_count;
+      return false;
+    }
+    if (entry->hash == hash) {
+      *first = entry->beat;
+      return true;
+    }
+    slot = (slot + 1) & (CYCLE_HISTORY - 1);
+  }
+}
@@ -0,0 +1,100 @@
+// grid.c
+
+static u32 grid_hash(i32 x, i32 y);
+static Grid_chunk** grid_chunk_find(Grid* grid, i32 cx, i32 cy);
+
+u32 grid_get(Grid* grid, i32 x, i32 y) {
+  i32 cx = grid_floor_div(x, GRID_CHUNK_SIZE);
+  i32 cy = grid_floor_div(y, GRID_CHUNK_SIZE);
+  Grid_chunk* chunk = *grid_chunk_find(grid, cx, cy);
+  if (!chunk) {
+    return NO_NODE;
+  }
+  return chunk->ids[(y - cy * GRID_CHUNK_SIZE) * GRID_CHUNK_SIZE + (x - cx * GRID_CHUNK_SIZE)];
+}
+
+Result grid_set(Grid* grid, i32 x, i32 y, u32 id) {
+  i32 cx = grid_floor_div(x, GRID_CHUNK_SIZE);
+  i32 cy = grid_floor_div(y, GRID_CHUNK_SIZE);
+  Grid_chunk** slot = grid_chunk_find(grid, cx, cy);
+  Grid_chunk* chunk = *slot;
+  if (!chunk) {
+    chunk = malloc(sizeof(Grid_chunk));
+    if (!chunk) {
+      log_error("grid_set: failed to allocate chunk (%d, %d)\n", cx, cy);
+      return Err;
+    }
+    chunk->x = cx;
+    chunk->y = cy;
+    chunk->count = 0;
+    for (u32 i = 0; i < GRID_CHUNK_CELLS; ++i) {
+      chunk->ids[i] = NO_NODE;
+    }
+    chunk->next = NULL;
+    *slot = chunk;
+    grid->chunk_count++;
+  }
+  u32* cell = &chunk->ids[(y - cy * GRID_CHUNK_SIZE) * GRID_CHUNK_SIZE + (x - cx * GRID_CHUNK_SIZE)];
+  if (*cell == NO_NODE) {
+    chunk->count++;
+  }
+  *cell = id;
+  return Ok;
+}
+
+void grid_clear(Grid* grid, i32 x, i32 y) {
+  i32 cx = grid_floor_div(x, GRID_CHUNK_SIZE);
+  i32 cy = grid_floor_div(y, GRID_CHUNK_SIZE);
+  Grid_chunk** slot = grid_chunk_find(grid, cx, cy);
+  Grid_chunk* chunk = *slot;
+  if (!chunk) {
+    return;
+  }
+  u32* cell = &chunk->ids[(y - cy * GRID_CHUNK_SIZE) * GRID_CHUNK_SIZE + (x - cx * GRID_CHUNK_SIZE)];
+  if (*cell == NO_NODE) {
+    return;
+  }
+  *cell = NO_NODE;
+  chunk->count--;
+  if (chunk->count == 0) {
+    *slot = chunk->next;
+    free(chunk);
+    grid->chunk_count--;
+  }
+}
+
+void grid_destroy(Grid* grid) {
+  for (u32 i = 0; i < GRID_BUCKETS; ++i) {
+    Grid_chunk* chunk = grid->buckets[i];
+    while (chunk) {
+      Grid_chunk* next = chunk->next;
+      free(chunk);
+      chunk = next;
+    }
+    grid->buckets[i] = NULL;
+  }
+  grid->chunk_count = 0;
+}
+
+u32 grid_hash(i32 x, i32 y) {
+  u32 hash = (u32)x * 0x9e3779b1u ^ (u32)y * 0x85ebca77u;
+  hash ^= hash >> 15;
+  return hash & (GRID_BUCKETS - 1);
+}
+
+i32 grid_floor_div(i32 a, i32 b) {
+  i32 q = a / b;
+  if ((a % b != 0) && ((a < 0) != (b < 0))) {
+    --q;
+  }
+  return q;
+}
+
+// the link pointing at the chunk, or at the end of its bucket when it isn't there
+Grid_chunk** grid_chunk_find(Grid* grid, i32 cx, i32 cy) {
+  Grid_chunk** slot = &grid->buckets[grid_hash(cx, cy)];
+  while (*slot && ((*slot)->x != cx || (*slot)->y != cy)) {
+    slot = &(*slot)->next;
+  }
+  return slot;
+}
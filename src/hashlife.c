@@ -0,0 +1,475 @@
+// hashlife.c
+// the grid is placed in the middle of an otherwise empty plane. a cell only
+// depends on its four neighbours, so the centre half of a square after 2^k
+// beats only depends on the square, and is remembered per square. empty cells
+// never change, which keeps the plane around the grid empty
+
+#define NO_QUAD ((u32)-1)
+
+#define CELL_ALIVE (1u << 31)
+#define CELL(TYPE, SENDS, VALUE) (CELL_ALIVE | (u32)(TYPE) << 20 | (u32)(SENDS) << 16 | (u32)(VALUE))
+#define CELL_TYPE(C) (((C) >> 20) & 0xff)
+#define CELL_SENDS(C) (((C) >> 16) & 0xf)
+#define CELL_VALUE(C) ((C) & 0xffff)
+
+enum { NW = 0, NE, SW, SE, };
+
+static Hashlife hashlife = {0};
+
+static Result hashlife_init(void);
+static void hashlife_reset(void);
+static u32 quad_hash(u32 level, u32 a, u32 b, u32 c, u32 d);
+static u32 quad_find(u32 level, u32 a, u32 b, u32 c, u32 d);
+static u32 quad_cell(u32 cell);
+static u32 quad_join(u32 nw, u32 ne, u32 sw, u32 se);
+static u32 quad_centre(u32 q);
+static u32 quad_step(u32 q, u32 step);
+static u32 quad_step_split(u32 q, u32 step);
+static u32 quad_step_base(u32 q);
+static u32 quad_build(u32 level, i32 x, i32 y);
+static void quad_read(u32 q, i32 x, i32 y);
+static u32 cell_step(u32 cell, u32 around[MAX_DIR]);
+
+Result hashlife_advance(Engine* e, u32 beats) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  Sync_buffers* sync = &e->sync;
+
+  // a cell has room for 16 bits of value
+  if (NODE_VALUE_BITS > 16) {
+    return Err;
+  }
+  if (hashlife_init() != Ok) {
+    return Err;
+  }
+  if (hashlife.max_cell < nodes->max_node) {
+    u32* cells = realloc(hashlife.cells, sizeof(u32) * nodes->max_node);
+    if (!cells) {
+      log_error("hashlife: failed to allocate cells\n");
+      return Err;
+    }
+    hashlife.cells = cells;
+    hashlife.max_cell = nodes->max_node;
+  }
+  u32* cells = hashlife.cells;
+  hashlife.width = nodes->grid_width;
+  hashlife.height = nodes->grid_height;
+  sync_touch(e);
+  // the quadtree only holds what is on the grid, not what a DELAY holds, what
+  // goes down a channel, the bank of a MEMORY or the body of a MACRO, and steps
+  // every CLOCK on every beat
+  if (!clocks_uniform(e) || index->channel_node_count > 0) {
+    return Err;
+  }
+  for (u32 i = 0; i < index->alive_count; ++i) {
+    if (!node_at_home(nodes, index->alive[i]) || nodes->type[index->alive[i]] == NODE_DELAY || nodes->type[index->alive[i]] == NODE_MEMORY || nodes->type[index->alive[i]] == NODE_MACRO) {
+      return Err;
+    }
+  }
+
+  memset(cells, 0, sizeof(u32) * nodes->max_node);
+  for (u32 i = 0; i < index->alive_count; ++i) {
+    u32 id = index->alive[i];
+    cells[id] = CELL(nodes->type[id], sync->sends[sync->current][id], nodes->data[id].value);
+  }
+
+  // one power of two at a time, the steps of a single advance are all the same size
+  for (u32 step = 0; step < 32 && (beats >> step) != 0; ++step) {
+    if (!((beats >> step) & 1)) {
+      continue;
+    }
+    // the grid has to stay inside the centre half, and the root has to be big
+    // enough to be advanced 2^step beats in one go
+    u32 level = 1;
+    while ((1u << (level - 1)) < MAX(hashlife.width, hashlife.height)) {
+      ++level;
+    }
+    level = MAX(level, step + 2);
+    if (level >= HASHLIFE_MAX_LEVEL) {
+      return Err;
+    }
+    for (u32 attempt = 0;; ++attempt) {
+      if (hashlife.quad_count > hashlife.max_quad / 2 || hashlife.memo_count > hashlife.max_memo / 2) {
+        hashlife_reset();
+      }
+      hashlife.origin_x = (i32)(1u << (level - 1)) - (i32)(hashlife.width / 2);
+      hashlife.origin_y = (i32)(1u << (level - 1)) - (i32)(hashlife.height / 2);
+      u32 root = quad_build(level, 0, 0);
+      u32 result = quad_step(root, step);
+      if (!hashlife.full) {
+        i32 quarter = 1 << (level - 2);
+        quad_read(result, quarter, quarter);
+        break;
+      }
+      hashlife_reset();
+      if (attempt > 0) {
+        log_error("hashlife: ran out of memory advancing 2^%u beats\n", step);
+        return Err;
+      }
+    }
+  }
+
+  for (u32 i = 0; i < index->alive_count; ++i) {
+    u32 id = index->alive[i];
+    nodes->data[id].value = CELL_VALUE(cells[id]);
+    sync->sends[sync->current][id] = CELL_SENDS(cells[id]);
+  }
+  sync_wake(e, NO_NODE);
+  clocks_skip(e, beats);
+  return Ok;
+}
+
+void hashlife_destroy(void) {
+  free(hashlife.cells);
+  free(hashlife.quads);
+  free(hashlife.buckets);
+  free(hashlife.memos);
+  free(hashlife.memo_buckets);
+  memset(&hashlife, 0, sizeof(hashlife));
+}
+
+Result hashlife_init(void) {
+  if (hashlife.quads) {
+    return Ok;
+  }
+  hashlife.max_quad = HASHLIFE_MAX_QUAD;
+  hashlife.max_memo = HASHLIFE_MAX_MEMO;
+  hashlife.quads = malloc(sizeof(Quad) * hashlife.max_quad);
+  hashlife.buckets = malloc(sizeof(u32) * HASHLIFE_BUCKETS);
+  hashlife.memos = malloc(sizeof(Quad_memo) * hashlife.max_memo);
+  hashlife.memo_buckets = malloc(sizeof(u32) * HASHLIFE_BUCKETS);
+  if (!hashlife.quads || !hashlife.buckets || !hashlife.memos || !hashlife.memo_buckets) {
+    log_error("hashlife: failed to allocate tables\n");
+    hashlife_destroy();
+    return Err;
+  }
+  hashlife_reset();
+  return Ok;
+}
+
+void hashlife_reset(void) {
+  memset(hashlife.buckets, 0xff, sizeof(u32) * HASHLIFE_BUCKETS);
+  memset(hashlife.memo_buckets, 0xff, sizeof(u32) * HASHLIFE_BUCKETS);
+  hashlife.quad_count = 0;
+  hashlife.memo_count = 0;
+  hashlife.full = false;
+  hashlife.empty[0] = quad_cell(0);
+  for (u32 level = 1; level < HASHLIFE_MAX_LEVEL; ++level) {
+    u32 e = hashlife.empty[level - 1];
+    hashlife.empty[level] = quad_join(e, e, e, e);
+  }
+}
+
+u32 quad_hash(u32 level, u32 a, u32 b, u32 c, u32 d) {
+  u64 hash = level;
+  hash = (hash ^ a) * 0x9e3779b97f4a7c15ull;
+  hash = (hash ^ b) * 0x9e3779b97f4a7c15ull;
+  hash = (hash ^ c) * 0x9e3779b97f4a7c15ull;
+  hash = (hash ^ d) * 0x9e3779b97f4a7c15ull;
+  return (u32)(hash >> 32) & (HASHLIFE_BUCKETS - 1);
+}
+
+// the one quad with these children, made if it doesn't exist yet
+u32 quad_find(u32 level, u32 a, u32 b, u32 c, u32 d) {
+  u32 bucket = quad_hash(level, a, b, c, d);
+  for (u32 i = hashlife.buckets[bucket]; i != NO_QUAD; i = hashlife.quads[i].next) {
+    Quad* q = &hashlife.quads[i];
+    if (q->level == level && q->child[0] == a && q->child[1] == b && q->child[2] == c && q->child[3] == d) {
+      return i;
+    }
+  }
+  if (hashlife.quad_count >= hashlife.max_quad) {
+    // keep the levels consistent so the step can unwind, the result is thrown away
+    hashlife.full = true;
+    return hashlife.empty[level];
+  }
+  u32 i = hashlife.quad_count++;
+  hashlife.quads[i] = (Quad) {
+    .child = { a, b, c, d, },
+    .level = level,
+    .next = hashlife.buckets[bucket],
+  };
+  hashlife.buckets[bucket] = i;
+  return i;
+}
+
+u32 quad_cell(u32 cell) {
+  return quad_find(0, cell, 0, 0, 0);
+}
+
+u32 quad_join(u32 nw, u32 ne, u32 sw, u32 se) {
+  return quad_find(hashlife.quads[nw].level + 1, nw, ne, sw, se);
+}
+
+u32 quad_centre(u32 q) {
+  Quad* quad = &hashlife.quads[q];
+  return quad_join(
+    hashlife.quads[quad->child[NW]].child[SE],
+    hashlife.quads[quad->child[NE]].child[SW],
+    hashlife.quads[quad->child[SW]].child[NE],
+    hashlife.quads[quad->child[SE]].child[NW]
+  );
+}
+
+// the centre half of q advanced by 2^step beats, step is at most level - 2
+u32 quad_step(u32 q, u32 step) {
+  u32 level = hashlife.quads[q].level;
+  assert(level >= 2 && step <= level - 2);
+  if (q == hashlife.empty[level] || hashlife.full) {
+    return hashlife.empty[level - 1];
+  }
+  u32 bucket = quad_hash(level, q, step, 0, 1);
+  for (u32 i = hashlife.memo_buckets[bucket]; i != NO_QUAD; i = hashlife.memos[i].next) {
+    if (hashlife.memos[i].quad == q && hashlife.memos[i].step == step) {
+      return hashlife.memos[i].result;
+    }
+  }
+  u32 result = level == 2 ? quad_step_base(q) : quad_step_split(q, step);
+  if (hashlife.memo_count >= hashlife.max_memo) {
+    hashlife.full = true;
+    return result;
+  }
+  u32 i = hashlife.memo_count++;
+  hashlife.memos[i] = (Quad_memo) {
+    .quad = q,
+    .step = step,
+    .result = result,
+    .next = hashlife.memo_buckets[bucket],
+  };
+  hashlife.memo_buckets[bucket] = i;
+  return result;
+}
+
+// split q into nine overlapping squares of half the size and advance their
+// four combinations in two halves of the time
+u32 quad_step_split(u32 q, u32 step) {
+  u32 level = hashlife.quads[q].level;
+  Quad quad = hashlife.quads[q];
+  Quad a = hashlife.quads[quad.child[NW]];
+  Quad b = hashlife.quads[quad.child[NE]];
+  Quad c = hashlife.quads[quad.child[SW]];
+  Quad d = hashlife.quads[quad.child[SE]];
+  u32 sub[3][3] = {
+    { quad.child[NW], quad_join(a.child[NE], b.child[NW], a.child[SE], b.child[SW]), quad.child[NE], },
+    { quad_join(a.child[SW], a.child[SE], c.child[NW], c.child[NE]), quad_join(a.child[SE], b.child[SW], c.child[NE], d.child[NW]), quad_join(b.child[SW], b.child[SE], d.child[NW], d.child[NE]), },
+    { quad.child[SW], quad_join(c.child[NE], d.child[NW], c.child[SE], d.child[SW]), quad.child[SE], },
+  };
+
+  // for the largest step both halves of the time are spent advancing, for smaller
+  // steps the first half only takes the centres
+  u32 half = step == level - 2;
+  u32 inner = half ? step - 1 : step;
+  u32 r[3][3];
+  for (u32 y = 0; y < 3; ++y) {
+    for (u32 x = 0; x < 3; ++x) {
+      r[y][x] = half ? quad_step(sub[y][x], inner) : quad_centre(sub[y][x]);
+    }
+  }
+  return quad_join(
+    quad_step(quad_join(r[0][0], r[0][1], r[1][0], r[1][1]), inner),
+    quad_step(quad_join(r[0][1], r[0][2], r[1][1], r[1][2]), inner),
+    quad_step(quad_join(r[1][0], r[1][1], r[2][0], r[2][1]), inner),
+    quad_step(quad_join(r[1][1], r[1][2], r[2][1], r[2][2]), inner)
+  );
+}
+
+// a 4x4 square, one beat for the 2x2 in the middle
+u32 quad_step_base(u32 q) {
+  u32 grid[4][4];
+  Quad* quad = &hashlife.quads[q];
+  for (u32 i = 0; i < 4; ++i) {
+    Quad* child = &hashlife.quads[quad->child[i]];
+    for (u32 j = 0; j < 4; ++j) {
+      u32 x = (i & 1) * 2 + (j & 1);
+      u32 y = (i >> 1) * 2 + (j >> 1);
+      grid[y][x] = hashlife.quads[child->child[j]].child[0];
+    }
+  }
+  u32 next[4];
+  for (u32 j = 0; j < 4; ++j) {
+    u32 x = 1 + (j & 1);
+    u32 y = 1 + (j >> 1);
+    u32 around[MAX_DIR] = {
+      [DIR_LEFT]  = grid[y][x - 1],
+      [DIR_RIGHT] = grid[y][x + 1],
+      [DIR_UP]    = grid[y - 1][x],
+      [DIR_DOWN]  = grid[y + 1][x],
+    };
+    next[j] = quad_cell(cell_step(grid[y][x], around));
+  }
+  return quad_join(next[NW], next[NE], next[SW], next[SE]);
+}
+
+// the quad at (x, y) in the plane, the grid starts at (origin_x, origin_y)
+u32 quad_build(u32 level, i32 x, i32 y) {
+  i32 size = 1 << level;
+  i32 ox = hashlife.origin_x;
+  i32 oy = hashlife.origin_y;
+  if (x + size <= ox || y + size <= oy || x >= ox + (i32)hashlife.width || y >= oy + (i32)hashlife.height) {
+    return hashlife.empty[level];
+  }
+  if (level == 0) {
+    return quad_cell(hashlife.cells[(y - oy) * hashlife.width + (x - ox)]);
+  }
+  i32 half = size / 2;
+  return quad_join(
+    quad_build(level - 1, x, y),
+    quad_build(level - 1, x + half, y),
+    quad_build(level - 1, x, y + half),
+    quad_build(level - 1, x + half, y + half)
+  );
+}
+
+void quad_read(u32 q, i32 x, i32 y) {
+  Quad* quad = &hashlife.quads[q];
+  i32 size = 1 << quad->level;
+  i32 ox = hashlife.origin_x;
+  i32 oy = hashlife.origin_y;
+  if (x + size <= ox || y + size <= oy || x >= ox + (i32)hashlife.width || y >= oy + (i32)hashlife.height) {
+    return;
+  }
+  if (quad->level == 0) {
+    hashlife.cells[(y - oy) * hashlife.width + (x - ox)] = quad->child[0];
+    return;
+  }
+  i32 half = size / 2;
+  quad_read(quad->child[NW], x, y);
+  quad_read(quad->child[NE], x + half, y);
+  quad_read(quad->child[SW], x, y + half);
+  quad_read(quad->child[SE], x + half, y + half);
+}
+
+// the same rules as sync_simulate_beat for one node, with the neighbours packed
+// the same way
+u32 cell_step(u32 cell, u32 around[MAX_DIR]) {
+  if (!(cell & CELL_ALIVE)) {
+    return cell;
+  }
+  u32 type = CELL_TYPE(cell);
+  Node_value value = CELL_VALUE(cell);
+
+  u32 listen = (1 << MAX_DIR) - 1;
+  u32 out = NO_NODE;
+  switch (type) {
+    case NODE_COPY_LR:
+      listen = 1 << DIR_LEFT;
+      out = DIR_RIGHT;
+      break;
+    case NODE_COPY_RL:
+      listen = 1 << DIR_RIGHT;
+      out = DIR_LEFT;
+      break;
+    case NODE_COPY_UD:
+      listen = 1 << DIR_UP;
+      out = DIR_DOWN;
+      break;
+    case NODE_COPY_DU:
+      listen = 1 << DIR_DOWN;
+      out = DIR_UP;
+      break;
+    default:
+      break;
+  }
+
+  Node_value values[MAX_DIR];
+  u32 count = 0;
+  u32 from = 0;
+  u32 neighbours = 0;
+  for (u32 d = 0; d < MAX_DIR; ++d) {
+    u32 n = around[d];
+    if (!(n & CELL_ALIVE)) {
+      continue;
+    }
+    neighbours |= 1 << d;
+    if (!(CELL_SENDS(n) & (1 << OPPOSITE(d)))) {
+      continue;
+    }
+    switch (CELL_TYPE(n)) {
+      case NODE_COPY:
+      case NODE_COPY_LR:
+      case NODE_COPY_RL:
+      case NODE_COPY_UD:
+      case NODE_COPY_DU:
+        value = CELL_VALUE(n); // the sender copies into us before we read
+        break;
+      default:
+        break;
+    }
+    if (listen & (1 << d)) {
+      values[count++] = CELL_VALUE(n);
+      from |= 1 << d;
+    }
+  }
+
+  u32 fire = false;
+  switch (type) {
+    case NODE_NONE:
+      break;
+    case NODE_CLOCK:
+      value += 1;
+      fire = true;
+      break;
+    case NODE_ADD:
+      if (count >= 2) {
+        value += values[0] + values[1];
+        fire = true;
+      }
+      break;
+    case NODE_BUS:
+      fire = count > 0;
+      break;
+    case NODE_AND:
+      if (count >= 2) {
+        value = values[0] && values[1];
+        fire = value != 0;
+      }
+      break;
+    case NODE_PRINT:
+      if (count > 0) {
+        value = values[count - 1];
+      }
+      break;
+    case NODE_INCR:
+      for (u32 n = 0; n < count; ++n) {
+        value += values[n];
+      }
+      fire = count > 0;
+      break;
+    case NODE_NOT:
+      if (count > 0) {
+        value = !values[0];
+        fire = true;
+      }
+      break;
+    case NODE_COPY:
+      if (count > 0) {
+        value = values[0];
+        fire = true;
+      }
+      break;
+    case NODE_EQUALS:
+      if (count >= 2) {
+        value = values[0] == values[1];
+        fire = value != 0;
+      }
+      break;
+    case NODE_COPY_LR:
+    case NODE_COPY_RL:
+    case NODE_COPY_UD:
+    case NODE_COPY_DU:
+      if (count > 0) {
+        value = values[0];
+        fire = (neighbours >> out) & 1;
+      }
+      break;
+    default:
+      assert(0);
+      break;
+  }
+
+  u32 sends = 0;
+  if (fire) {
+    sends = out != NO_NODE ? 1u << out : neighbours & ~from;
+  }
+  return CELL(type, sends, value);
+}
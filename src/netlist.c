@@ -0,0 +1,516 @@
+// netlist.c
+
+static void netlist_run(Engine* e, Vm* vm);
+static void netlist_dispatch(Engine* e, Vm* vm, u32 pc, u32 input, Node_value input_value);
+static void netlist_finalize(Engine* e, Vm* vm, Instruction* ins);
+static void netlist_release(Engine* e, Vm* vm, Wheel_entry* entry);
+
+void netlist_alloc(Engine* e, Arena* arena) {
+  Netlist* netlist = &e->netlist;
+  u32 max_node = e->state.nodes.max_node;
+  netlist->program = arena_alloc(arena, sizeof(Instruction) * max_node);
+  netlist->pc = arena_alloc(arena, sizeof(u32) * max_node);
+  netlist->clocks = arena_alloc(arena, sizeof(u32) * max_node);
+  // same bound as the frames of the event engine
+  netlist->max_frame = max_node * MAX_WRITES;
+  netlist->frames = arena_alloc(arena, sizeof(Vm_frame) * netlist->max_frame);
+}
+
+void netlist_compile(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  Node_graph* graph = &e->graph;
+  Netlist* netlist = &e->netlist;
+
+  if (graph->dirty) {
+    node_graph_compile(e);
+  }
+
+  netlist->count = index->alive_count;
+  netlist->delay_count = 0;
+  netlist->memory_count = 0;
+  netlist->macro_count = 0;
+  for (u32 i = 0; i < index->alive_count; ++i) {
+    netlist->pc[index->alive[i]] = i;
+    netlist->delay_count += nodes->type[index->alive[i]] == NODE_DELAY;
+    netlist->memory_count += nodes->type[index->alive[i]] == NODE_MEMORY;
+    netlist->macro_count += nodes->type[index->alive[i]] == NODE_MACRO;
+  }
+  netlist->channel_count = index->channel_node_count;
+
+  for (u32 i = 0; i < netlist->count; ++i) {
+    Instruction* ins = &netlist->program[i];
+    u32 id = index->alive[i];
+    u32 in = NO_NODE;
+    u32 out = NO_NODE;
+    switch (nodes->type[id]) {
+      case NODE_COPY_LR:
+        in = graph->dir[id][DIR_LEFT];
+        out = graph->dir[id][DIR_RIGHT];
+        break;
+      case NODE_COPY_RL:
+        in = graph->dir[id][DIR_RIGHT];
+        out = graph->dir[id][DIR_LEFT];
+        break;
+      case NODE_COPY_UD:
+        in = graph->dir[id][DIR_UP];
+        out = graph->dir[id][DIR_DOWN];
+        break;
+      case NODE_COPY_DU:
+        in = graph->dir[id][DIR_DOWN];
+        out = graph->dir[id][DIR_UP];
+        break;
+      case NODE_MEMORY:
+        in = graph->dir[id][DIR_LEFT];
+        out = graph->dir[id][DIR_RIGHT];
+        break;
+      default:
+        break;
+    }
+    ins->op = nodes->type[id];
+    ins->reads = node_events[ins->op].reads;
+    ins->node = id;
+    ins->in = in != NO_NODE ? netlist->pc[in] : NO_NODE;
+    ins->out = out != NO_NODE ? netlist->pc[out] : NO_NODE;
+    ins->count = graph->count[id];
+    for (u32 n = 0; n < ins->count; ++n) {
+      ins->targets[n] = netlist->pc[graph->ids[graph->offset[id] + n]];
+    }
+  }
+
+  netlist->clock_count = index->clock_count;
+  for (u32 i = 0; i < index->clock_count; ++i) {
+    netlist->clocks[i] = netlist->pc[index->clocks[i]];
+  }
+  netlist->generation = index->generation;
+}
+
+void netlist_update(Engine* e) {
+  if (e->netlist.generation != e->index.generation) {
+    netlist_compile(e);
+  }
+  channels_update(e);
+}
+
+void netlist_trigger_clocks(Engine* e) {
+  Netlist* netlist = &e->netlist;
+  Node_index* index = &e->index;
+  netlist_update(e);
+
+  Vm vm = {
+    .first = 0,
+    .last = e->state.nodes.max_node,
+    .frames = netlist->frames,
+    .max_frame = netlist->max_frame,
+    .not_ready = index->not_ready,
+    .not_ready_count = index->not_ready_count,
+  };
+  for (u32 i = 0; i < e->wheel.due_count; ++i) {
+    netlist_release(e, &vm, &e->wheel.due[i]);
+  }
+  for (u32 i = 0; i < e->clocks.due_count; ++i) {
+    netlist_fire(e, &vm, netlist->pc[e->clocks.due[i]]);
+  }
+  index->not_ready_count = vm.not_ready_count;
+  e->event_count += vm.event_count;
+}
+
+void netlist_fire(Engine* e, Vm* vm, u32 pc) {
+  u32 node = e->netlist.program[pc].node;
+  if (e->prune && !e->analysis.live[node]) {
+    return;
+  }
+  e->state.nodes.ready[node] = true;
+  netlist_dispatch(e, vm, pc, NO_NODE, 0);
+  netlist_run(e, vm);
+}
+
+// same as node_event_release
+void netlist_release(Engine* e, Vm* vm, Wheel_entry* entry) {
+  Nodes* nodes = &e->state.nodes;
+  Netlist* netlist = &e->netlist;
+  u32 self = entry->node;
+  if (!nodes->alive[self] || nodes->type[self] != NODE_DELAY || nodes->writes[self] >= MAX_WRITES) {
+    return;
+  }
+  if (e->prune && !e->analysis.live[self]) {
+    return;
+  }
+  u32 pc = netlist->pc[self];
+  u32 input = entry->input != NO_NODE && nodes->alive[entry->input] ? netlist->pc[entry->input] : NO_NODE;
+  nodes->ready[self] = true;
+  nodes->data[self].value = entry->value;
+  vm->event_count++;
+  assert(vm->frame_count < vm->max_frame);
+  vm->frames[vm->frame_count++] = (Vm_frame) {
+    .pc = pc,
+    .input = input,
+    .channel = NO_NODE,
+    .index = 0,
+    .forward = false,
+  };
+  netlist_run(e, vm);
+}
+
+// same depth-first drain as node_event_callback, but dispatching on the opcode
+// instead of through node_events
+void netlist_run(Engine* e, Vm* vm) {
+  Nodes* nodes = &e->state.nodes;
+  Instruction* program = e->netlist.program;
+
+  while (vm->frame_count > 0) {
+    Vm_frame* frame = &vm->frames[vm->frame_count - 1];
+    Instruction* ins = &program[frame->pc];
+    u32 target = NO_NODE;
+    u32 side = 0;
+    if (frame->channel != NO_NODE) {
+      Channel* channel = &e->channels.channels[frame->channel];
+      if (frame->index < channel->receive_count) {
+        target = e->netlist.pc[e->channels.members[channel->first + channel->send_count + frame->index++]];
+      }
+    }
+    else if (frame->forward) {
+      if (frame->index == 0) {
+        target = ins->out;
+        frame->index = 1;
+      }
+    }
+    else if (ins->op == NODE_MACRO) {
+      while (frame->index < MAX_DIR) {
+        u32 d = frame->index++;
+        u32 n = e->graph.dir[ins->node][d];
+        if ((frame->sides & (1 << d)) && n != NO_NODE) {
+          target = e->netlist.pc[n];
+          side = d;
+          break;
+        }
+      }
+    }
+    else {
+      while (frame->index < ins->count) {
+        u32 t = ins->targets[frame->index++];
+        if (t != frame->input) { // don't loop back
+          target = t;
+          break;
+        }
+      }
+    }
+    if (target == NO_NODE) {
+      --vm->frame_count;
+      netlist_finalize(e, vm, ins);
+      continue;
+    }
+    // a SEND paid for the whole channel when it fired
+    if (frame->channel == NO_NODE) {
+      nodes->writes[ins->node]++;
+      e->node_colors[ins->node] = colors[COLOR_RED];
+    }
+    u32 copy = false;
+    switch (ins->op) {
+      case NODE_SEND:
+      case NODE_COPY:
+      case NODE_COPY_LR:
+      case NODE_COPY_RL:
+      case NODE_COPY_UD:
+      case NODE_COPY_DU:
+        copy = true;
+        break;
+      case NODE_MACRO:
+        copy = subcircuits_copies(e, ins->node, side);
+        break;
+      default:
+        break;
+    }
+    u32 node = program[target].node;
+    if (e->prune && !e->analysis.live[node]) {
+      continue;
+    }
+    // a MACRO sends every side the last value that left its body there
+    if (ins->op == NODE_MACRO) {
+      nodes->data[ins->node].value = subcircuits_of(e, ins->node)->out[0][side];
+    }
+    Node_value value = nodes->data[ins->node].value;
+    assert(node >= vm->first && node < vm->last);
+    if (copy) {
+      nodes->data[node].value = value;
+    }
+    netlist_dispatch(e, vm, target, frame->pc, value);
+  }
+}
+
+void netlist_finalize(Engine* e, Vm* vm, Instruction* ins) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  u32 id = ins->node;
+  if (nodes->reads[id] >= ins->reads || nodes->writes[id] >= MAX_WRITES) {
+    nodes->ready[id] = false;
+    if (!index->not_ready_listed[id]) {
+      index->not_ready_listed[id] = true;
+      vm->not_ready[vm->not_ready_count++] = id;
+    }
+  }
+}
+
+// input_value is the value input had when it sent, the input node itself may
+// belong to another vm
+void netlist_dispatch(Engine* e, Vm* vm, u32 pc, u32 input, Node_value input_value) {
+  Nodes* nodes = &e->state.nodes;
+  Instruction* program = e->netlist.program;
+  Instruction* ins = &program[pc];
+  u32 self = ins->node;
+
+  if (!nodes->ready[self]) {
+    return;
+  }
+  if (ins->reads == 0) {
+    input = NO_NODE;
+  }
+  else if (nodes->reads[self] >= ins->reads) {
+    return;
+  }
+  if (nodes->writes[self] >= MAX_WRITES) {
+    return;
+  }
+  vm->event_count++;
+
+  u32 in = input != NO_NODE ? program[input].node : NO_NODE;
+  Node_value* value = &nodes->data[self].value;
+  u32 broadcast = false;
+  u32 forward = false;
+  u32 channel = NO_NODE;
+  u32 sides = 0;
+
+  switch (ins->op) {
+    case NODE_NONE: {
+      nodes->reads[self]++;
+      e->node_colors[self] = colors[COLOR_GREEN];
+      break;
+    }
+    case NODE_CLOCK: {
+      *value += 1;
+      broadcast = true;
+      break;
+    }
+    case NODE_ADD: {
+      if (in != NO_NODE) {
+        u8 reads = ++nodes->reads[self];
+        e->node_colors[self] = colors[COLOR_GREEN];
+        *value += input_value;
+        broadcast = reads == 2;
+      }
+      break;
+    }
+    case NODE_BUS: {
+      if (in != NO_NODE) {
+        nodes->reads[self]++;
+        e->node_colors[self] = colors[COLOR_GREEN];
+      }
+      broadcast = true;
+      break;
+    }
+    case NODE_AND: {
+      if (in != NO_NODE) {
+        u8 reads = ++nodes->reads[self];
+        e->node_colors[self] = colors[COLOR_GREEN];
+        if (reads == 1) {
+          *value = input_value;
+        }
+        else {
+          *value = *value && input_value;
+          broadcast = *value != 0;
+        }
+      }
+      break;
+    }
+    case NODE_PRINT: {
+      if (in != NO_NODE) {
+        nodes->reads[self]++;
+        e->node_colors[self] = colors[COLOR_GREEN];
+        *value = input_value;
+        if (vm->prints) {
+          assert(vm->print_count < vm->max_print);
+          vm->prints[vm->print_count++] = (Vm_print) {
+            .type = nodes->type[in],
+            .value = *value,
+          };
+        }
+        else {
+          signal_engine_log(e, "node", "%s: " NODE_VALUE_FMT, node_type_str[nodes->type[in]], *value);
+          log_info("%s: " NODE_VALUE_FMT "\n", node_type_str[nodes->type[in]], *value);
+        }
+      }
+      break;
+    }
+    case NODE_INCR: {
+      if (in != NO_NODE) {
+        nodes->reads[self]++;
+        e->node_colors[self] = colors[COLOR_GREEN];
+        *value += input_value;
+        broadcast = true;
+      }
+      break;
+    }
+    case NODE_NOT: {
+      if (in != NO_NODE) {
+        nodes->reads[self]++;
+        e->node_colors[self] = colors[COLOR_GREEN];
+        *value = !input_value;
+        broadcast = true;
+      }
+      break;
+    }
+    case NODE_COPY: {
+      if (in != NO_NODE) {
+        nodes->reads[self]++;
+        e->node_colors[self] = colors[COLOR_GREEN];
+        *value = input_value;
+        broadcast = true;
+      }
+      break;
+    }
+    case NODE_EQUALS: {
+      if (in != NO_NODE) {
+        u8 reads = ++nodes->reads[self];
+        e->node_colors[self] = colors[COLOR_GREEN];
+        if (reads == 1) {
+          *value = input_value;
+        }
+        else {
+          *value = *value == input_value;
+          broadcast = *value != 0;
+        }
+      }
+      break;
+    }
+    case NODE_COPY_LR:
+    case NODE_COPY_RL:
+    case NODE_COPY_UD:
+    case NODE_COPY_DU: {
+      if (in != NO_NODE && input == ins->in) {
+        nodes->reads[self]++;
+        e->node_colors[self] = colors[COLOR_GREEN];
+        *value = input_value;
+        forward = ins->out != NO_NODE;
+      }
+      break;
+    }
+    case NODE_DELAY: {
+      if (in != NO_NODE) {
+        nodes->reads[self]++;
+        e->node_colors[self] = colors[COLOR_GREEN];
+        wheel_schedule(e, self, in, input_value);
+      }
+      break;
+    }
+    case NODE_SEND: {
+      if (in != NO_NODE) {
+        nodes->reads[self]++;
+        e->node_colors[self] = colors[COLOR_GREEN];
+        *value = input_value;
+      }
+      nodes->writes[self]++;
+      e->node_colors[self] = colors[COLOR_RED];
+      channel = e->channels.group[self];
+      break;
+    }
+    case NODE_MEMORY: {
+      Bank* bank = banks_of(e, self);
+      if (!bank) {
+        break;
+      }
+      Node_value* words = banks_words(e, bank);
+      u32* dir = e->graph.dir[self];
+      u32 load = in == NO_NODE;
+      if (in != NO_NODE && input == ins->in) {
+        nodes->reads[self]++;
+        e->node_colors[self] = colors[COLOR_GREEN];
+        bank->address = input_value & BANK_MASK;
+        load = true;
+      }
+      else if (in != NO_NODE && in == dir[DIR_UP]) {
+        nodes->reads[self]++;
+        e->node_colors[self] = colors[COLOR_GREEN];
+        bank->data = input_value;
+      }
+      else if (in != NO_NODE && in == dir[DIR_DOWN]) {
+        nodes->reads[self]++;
+        e->node_colors[self] = colors[COLOR_GREEN];
+        if (input_value != 0) {
+          words[bank->address] = bank->data;
+        }
+      }
+      if (load) {
+        *value = words[bank->address];
+        forward = ins->out != NO_NODE;
+      }
+      break;
+    }
+    case NODE_RECEIVE: {
+      if (in == NO_NODE || nodes->type[in] == NODE_SEND) {
+        if (in != NO_NODE) {
+          nodes->reads[self]++;
+          e->node_colors[self] = colors[COLOR_GREEN];
+        }
+        input = NO_NODE;
+        broadcast = true;
+      }
+      break;
+    }
+    case NODE_MACRO: {
+      Instance* instance = subcircuits_of(e, self);
+      if (!instance) {
+        break;
+      }
+      u32* dir = e->graph.dir[self];
+      if (in != NO_NODE) {
+        u32 side = 0;
+        while (side < MAX_DIR && dir[side] != in) {
+          ++side;
+        }
+        if (side == MAX_DIR) {
+          break;
+        }
+        nodes->reads[self]++;
+        e->node_colors[self] = colors[COLOR_GREEN];
+        sides = subcircuits_run(e, self, side, input_value, subcircuits_copies(e, in, OPPOSITE(side)), nodes->type[in], instance->out[0]);
+      }
+      else {
+        for (u32 d = 0; d < MAX_DIR; ++d) {
+          instance->out[0][d] = *value;
+        }
+        sides = (1 << MAX_DIR) - 1;
+      }
+      for (u32 d = 0; d < MAX_DIR; ++d) {
+        if (dir[d] == NO_NODE) {
+          sides &= ~(1 << d);
+        }
+      }
+      break;
+    }
+    default:
+      assert(0);
+      break;
+  }
+
+  u32 count = sides != 0;
+  if (broadcast) {
+    for (u32 i = 0; i < ins->count; ++i) {
+      count += ins->targets[i] != input;
+    }
+  }
+  if (channel != NO_NODE) {
+    count = e->channels.channels[channel].receive_count;
+  }
+  if (count == 0 && !forward) {
+    netlist_finalize(e, vm, ins);
+    return;
+  }
+  assert(vm->frame_count < vm->max_frame);
+  Vm_frame* frame = &vm->frames[vm->frame_count++];
+  frame->pc = pc;
+  frame->input = input;
+  frame->channel = channel;
+  frame->index = 0;
+  frame->forward = forward;
+  frame->sides = sides;
+}
@@ -2,45 +2,84 @@
 
 #define BORDER_THICKNESS 2
 
-#define MAX_NEIGHBOUR 4
-#define MAX_READS 4
-#define MAX_WRITES 4
+// pending broadcast of a node, drained one target at a time. a SEND drains the
+// RECEIVEs of its channel instead of its neighbours
+typedef struct {
+  u32 self;
+  u32 targets[MAX_NEIGHBOUR];
+  u32 channel; // NO_NODE unless it writes to a channel
+  u32 count;
+  u32 index;
+  u8 finalize;
+} Event_frame;
 
-static Node copy_data;
-static Node* copy = NULL;
+typedef struct {
+  u8 type;
+  Node_data data;
+  u32 delay;
+  u32 period;
+  u32 phase;
+  u32 channel;
+  u32 body;
+  u32 id;
+} Node_copy;
 
-static Node* node_from_grid_pos(Engine* e, u32 x, u32 y);
-static Result id_to_grid_pos(Node* node, u32* x, u32* y);
-static Result node_to_grid_pos(Node* node, u32* x, u32* y);
-static void node_get_alive_neighbours(Engine* e, Node* node, Node* neighbours[MAX_NEIGHBOUR], u32* count);
-static Node* node_get_alive_neighbour(Engine* e, Node* node, i32 delta_x, i32 delta_y);
-static void node_copy(Node* dest, Node* src);
+static i32 mark_x = 0;
+static i32 mark_y = 0;
+static u32 marked = false; // a corner of a region to capture
+
+static Node_copy copy_data;
+static Node_copy* copy = NULL;
+
+static Event_frame* event_frames = NULL;
+static u32 event_frame_count = 0;
+static u32 max_event_frame = 0;
+
+static u32 node_from_grid_pos(Engine* e, i32 x, i32 y);
+static Result node_grid_from_screen_pos(i32 x, i32 y, i32* grid_x, i32* grid_y);
+static u32 node_grid_neighbour(Engine* e, u32 id, Direction dir);
+static void node_graph_patch(Engine* e, u32 id);
+static void nodes_trigger_clocks(Engine* e);
+static void node_copy(Nodes* nodes, u32 dest, Node_copy* src);
+static void node_list_insert(u32* list, u32* count, u32 id);
+static void node_list_remove(u32* list, u32* count, u32 id);
 
 // broadcast to neighbours
-static u32 node_broadcast(Node* node, Node* input, Engine* e);
-static u16 node_increment_writes(Node* self);
-static u16 node_increment_reads(Node* self);
-static u32 node_safe_guard(Node* self);
-static u32 node_finalize(Node* self);
-
-static void node_event_callback(Node* node, Node* input, Engine* e);
-
-static void node_event_none(Node* self, Node* input, Engine* e);
-static void node_event_clock(Node* self, Node* input, Engine* e);
-static void node_event_add(Node* self, Node* input, Engine* e);
-static void node_event_bus(Node* self, Node* input, Engine* e);
-static void node_event_and(Node* self, Node* input, Engine* e);
-static void node_event_print(Node* self, Node* input, Engine* e);
-static void node_event_incr(Node* self, Node* input, Engine* e);
-static void node_event_not(Node* self, Node* input, Engine* e);
-static void node_event_copy(Node* self, Node* input, Engine* e);
-static void node_event_equals(Node* self, Node* input, Engine* e);
-static void node_event_copy_lr(Node* self, Node* input, Engine* e);
-static void node_event_copy_rl(Node* self, Node* input, Engine* e);
-static void node_event_copy_ud(Node* self, Node* input, Engine* e);
-static void node_event_copy_du(Node* self, Node* input, Engine* e);
-
-static void node_broadcast_event_copy(Node* self, Node* input, Engine* e);
+static u32 node_broadcast(u32 node, u32 input, Engine* e);
+static void node_forward(u32 self, u32 target);
+static u16 node_increment_writes(u32 self, Engine* e);
+static u16 node_increment_reads(u32 self, Engine* e);
+static u32 node_safe_guard(u32 self, Engine* e);
+static u32 node_finalize(u32 self);
+
+static void node_event_callback(u32 node, u32 input, Engine* e);
+static void node_event_release(Engine* e, u32 node, u32 input, Node_value value);
+static void node_event_drain(Engine* e);
+static void node_event_dispatch(u32 node, u32 input, Engine* e);
+static void node_event_frame_pop(Engine* e);
+
+static void node_event_none(u32 self, u32 input, Engine* e);
+static void node_event_clock(u32 self, u32 input, Engine* e);
+static void node_event_add(u32 self, u32 input, Engine* e);
+static void node_event_bus(u32 self, u32 input, Engine* e);
+static void node_event_and(u32 self, u32 input, Engine* e);
+static void node_event_print(u32 self, u32 input, Engine* e);
+static void node_event_incr(u32 self, u32 input, Engine* e);
+static void node_event_not(u32 self, u32 input, Engine* e);
+static void node_event_copy(u32 self, u32 input, Engine* e);
+static void node_event_equals(u32 self, u32 input, Engine* e);
+static void node_event_copy_lr(u32 self, u32 input, Engine* e);
+static void node_event_copy_rl(u32 self, u32 input, Engine* e);
+static void node_event_copy_ud(u32 self, u32 input, Engine* e);
+static void node_event_copy_du(u32 self, u32 input, Engine* e);
+static void node_event_delay(u32 self, u32 input, Engine* e);
+static void node_event_send(u32 self, u32 input, Engine* e);
+static void node_event_receive(u32 self, u32 input, Engine* e);
+static void node_event_memory(u32 self, u32 input, Engine* e);
+static void node_event_macro(u32 self, u32 input, Engine* e);
+
+static void node_broadcast_event_copy(u32 self, u32 input, Engine* e);
+static void node_broadcast_event_macro(u32 self, u32 input, Engine* e);
 
 static Node_event node_events[MAX_NODE_TYPE] = {
   [NODE_NONE]    = { .event = node_event_none,    .broadcast = NULL, .reads = 0, },
@@ -53,155 +92,291 @@ static Node_event node_events[MAX_NODE_TYPE] = {
   [NODE_NOT]     = { .event = node_event_not,     .broadcast = NULL, .reads = 1, },
   [NODE_COPY]    = { .event = node_event_copy,    .broadcast = node_broadcast_event_copy, .reads = 1, },
   [NODE_EQUALS]  = { .event = node_event_equals,  .broadcast = NULL, .reads = 2, },
-  [NODE_COPY_LR] = { .event = node_event_copy_lr, .broadcast = NULL, .reads = 1, },
-  [NODE_COPY_RL] = { .event = node_event_copy_rl, .broadcast = NULL, .reads = 1, },
-  [NODE_COPY_UD] = { .event = node_event_copy_ud, .broadcast = NULL, .reads = 1, },
-  [NODE_COPY_DU] = { .event = node_event_copy_du, .broadcast = NULL, .reads = 1, },
+  [NODE_COPY_LR] = { .event = node_event_copy_lr, .broadcast = node_broadcast_event_copy, .reads = 1, },
+  [NODE_COPY_RL] = { .event = node_event_copy_rl, .broadcast = node_broadcast_event_copy, .reads = 1, },
+  [NODE_COPY_UD] = { .event = node_event_copy_ud, .broadcast = node_broadcast_event_copy, .reads = 1, },
+  [NODE_COPY_DU] = { .event = node_event_copy_du, .broadcast = node_broadcast_event_copy, .reads = 1, },
+  [NODE_DELAY]   = { .event = node_event_delay,   .broadcast = NULL, .reads = 1, },
+  [NODE_SEND]    = { .event = node_event_send,    .broadcast = node_broadcast_event_copy, .reads = 1, },
+  [NODE_RECEIVE] = { .event = node_event_receive, .broadcast = NULL, .reads = 1, },
+  [NODE_MEMORY]  = { .event = node_event_memory,  .broadcast = NULL, .reads = 3, },
+  [NODE_MACRO]   = { .event = node_event_macro,   .broadcast = node_broadcast_event_macro, .reads = MAX_DIR, },
+};
+
+static beat_event sim_engine_beats[MAX_SIM_ENGINE] = {
+  [SIM_ENGINE_EVENT]  = nodes_trigger_clocks,
+  [SIM_ENGINE_VM]     = netlist_trigger_clocks,
+  [SIM_ENGINE_NATIVE] = codegen_trigger_clocks,
+  [SIM_ENGINE_TILES]  = tiles_trigger_clocks,
 };
 
-void node_event_callback(Node* node, Node* input, Engine* e) {
-  if (!node) {
+// process an event and everything it triggers, the broadcast cascade is drained
+// depth-first from an explicit stack so the order matches a recursive walk
+void node_event_callback(u32 node, u32 input, Engine* e) {
+  if (e->graph.dirty) {
+    node_graph_compile(e);
+  }
+  channels_update(e);
+  if (e->prune) {
+    analysis_update(e);
+  }
+  node_event_dispatch(node, input, e);
+  node_event_drain(e);
+}
+
+// a DELAY sends on a value it held as if it had just read it, to every
+// neighbour but the one it came from
+void node_event_release(Engine* e, u32 node, u32 input, Node_value value) {
+  Nodes* nodes = &e->state.nodes;
+  if (!nodes->alive[node] || nodes->type[node] != NODE_DELAY || nodes->writes[node] >= MAX_WRITES) {
+    return;
+  }
+  if (e->graph.dirty) {
+    node_graph_compile(e);
+  }
+  channels_update(e);
+  if (e->prune && !e->analysis.live[node]) {
     return;
   }
-  if (!node->ready) {
+  nodes->ready[node] = true;
+  nodes->data[node].value = value;
+  assert(event_frame_count < max_event_frame);
+  Event_frame* frame = &event_frames[event_frame_count++];
+  frame->self = node;
+  frame->channel = NO_NODE;
+  frame->count = 0;
+  frame->index = 0;
+  frame->finalize = true;
+  e->event_count++;
+  node_broadcast(node, input, e);
+  if (frame->count == 0) {
+    node_event_frame_pop(e);
+  }
+  node_event_drain(e);
+}
+
+void node_event_drain(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  while (event_frame_count > 0) {
+    Event_frame* frame = &event_frames[event_frame_count - 1];
+    if (frame->index >= frame->count) {
+      node_event_frame_pop(e);
+      continue;
+    }
+    u32 self = frame->self;
+    u32 target = NO_NODE;
+    if (frame->channel != NO_NODE) {
+      Channel* channel = &e->channels.channels[frame->channel];
+      target = e->channels.members[channel->first + channel->send_count + frame->index++];
+    }
+    else {
+      target = frame->targets[frame->index++];
+      node_increment_writes(self, e);
+    }
+    if (e->prune && !e->analysis.live[target]) {
+      continue;
+    }
+    Node_event* event = &node_events[nodes->type[self]];
+    if (event->broadcast) {
+      event->broadcast(self, target, e);
+    }
+    node_event_dispatch(target, self, e);
+  }
+}
+
+void node_event_dispatch(u32 node, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (node == NO_NODE) {
     return;
   }
-  assert(node->type < MAX_NODE_TYPE);
-  Node_event* event = &node_events[node->type];
-  if (node->reads < event->reads && node->writes < MAX_WRITES) {
-    event->event(node, input, e);
+  if (!nodes->ready[node]) {
     return;
   }
-  if (event->reads == 0 && node->writes < MAX_WRITES) {
-    event->event(node, NULL, e);
+  assert(nodes->type[node] < MAX_NODE_TYPE);
+  Node_event* event = &node_events[nodes->type[node]];
+  if (event->reads == 0) {
+    input = NO_NODE;
+  }
+  else if (nodes->reads[node] >= event->reads) {
+    return;
+  }
+  if (nodes->writes[node] >= MAX_WRITES) {
+    return;
+  }
+  assert(event_frame_count < max_event_frame);
+  Event_frame* frame = &event_frames[event_frame_count++];
+  frame->self = node;
+  frame->channel = NO_NODE;
+  frame->count = 0;
+  frame->index = 0;
+  frame->finalize = false;
+  e->event_count++;
+  event->event(node, input, e);
+  if (frame->count == 0) {
+    node_event_frame_pop(e);
   }
 }
 
-void node_event_none(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_frame_pop(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  assert(event_frame_count > 0);
+  Event_frame* frame = &event_frames[--event_frame_count];
+  if (!frame->finalize) {
     return;
   }
-  node_increment_reads(self);
+  u32 self = frame->self;
+  Node_event* event = &node_events[nodes->type[self]];
+  if (nodes->reads[self] >= event->reads || nodes->writes[self] >= MAX_WRITES) {
+    node_set_not_ready(e, self); // we're done processing this node
+  }
+}
+
+void node_set_not_ready(Engine* e, u32 id) {
+  Node_index* index = &e->index;
+  e->state.nodes.ready[id] = false;
+  if (!index->not_ready_listed[id]) {
+    index->not_ready_listed[id] = true;
+    index->not_ready[index->not_ready_count++] = id;
+  }
+}
+
+void node_event_none(u32 self, u32 input, Engine* e) {
+  if (!node_safe_guard(self, e)) {
+    return;
+  }
+  node_increment_reads(self, e);
   node_finalize(self);
 }
 
-void node_event_clock(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_clock(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
     return;
   }
-  self->data.value++;
+  nodes->data[self].value++;
   node_broadcast(self, input, e);
   node_finalize(self);
 }
 
-void node_event_add(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_add(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
     return;
   }
 
-  u16 reads = node_increment_reads(self);
-  self->data.value += input->data.value;
-  if (reads == 2) {
-    node_broadcast(self, input, e);
-  }
-  else if (reads > 2) {
-    assert(0);
+  if (input != NO_NODE) {
+    u16 reads = node_increment_reads(self, e);
+    nodes->data[self].value += nodes->data[input].value;
+    if (reads == 2) {
+      node_broadcast(self, input, e);
+    }
+    else if (reads > 2) {
+      assert(0);
+    }
   }
   node_finalize(self);
 }
 
-void node_event_bus(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_bus(u32 self, u32 input, Engine* e) {
+  if (!node_safe_guard(self, e)) {
     return;
   }
-  if (input) {
-    node_increment_reads(self);
+  if (input != NO_NODE) {
+    node_increment_reads(self, e);
   }
   node_broadcast(self, input, e);
   node_finalize(self);
 }
 
-void node_event_and(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_and(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
     return;
   }
-  u16 reads = node_increment_reads(self);
-  if (reads == 1) {
-    self->data.value = input->data.value;
-  }
-  else if (reads == 2) {
-    self->data.value = self->data.value && input->data.value;
-    if (self->data.value) {
-      node_broadcast(self, input, e);
+  if (input != NO_NODE) {
+    u16 reads = node_increment_reads(self, e);
+    if (reads == 1) {
+      nodes->data[self].value = nodes->data[input].value;
+    }
+    else if (reads == 2) {
+      nodes->data[self].value = nodes->data[self].value && nodes->data[input].value;
+      if (nodes->data[self].value) {
+        node_broadcast(self, input, e);
+      }
+    }
+    else {
+      assert(0);
     }
-  }
-  else {
-    assert(0);
   }
   node_finalize(self);
 }
 
-void node_event_print(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_print(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
     return;
   }
-  if (input) {
-    node_increment_reads(self);
-    self->data = input->data;
-    signal_engine_log(e, "node", "%s: %u", node_type_str[input->type], self->data.value);
-    log_info("%s: %u\n", node_type_str[input->type], self->data.value);
+  if (input != NO_NODE) {
+    node_increment_reads(self, e);
+    nodes->data[self] = nodes->data[input];
+    signal_engine_log(e, "node", "%s: " NODE_VALUE_FMT, node_type_str[nodes->type[input]], nodes->data[self].value);
+    log_info("%s: " NODE_VALUE_FMT "\n", node_type_str[nodes->type[input]], nodes->data[self].value);
   }
   node_finalize(self);
 }
 
-void node_event_incr(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_incr(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
     return;
   }
-  if (input) {
-    node_increment_reads(self);
-    self->data.value += input->data.value;
+  if (input != NO_NODE) {
+    node_increment_reads(self, e);
+    nodes->data[self].value += nodes->data[input].value;
     node_broadcast(self, input, e);
   }
   node_finalize(self);
 }
 
-void node_event_not(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_not(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
     return;
   }
-  if (input) {
-    node_increment_reads(self);
-    self->data.value = !input->data.value;
+  if (input != NO_NODE) {
+    node_increment_reads(self, e);
+    nodes->data[self].value = !nodes->data[input].value;
     node_broadcast(self, input, e);
   }
   node_finalize(self);
 }
 
-void node_event_copy(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_copy(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
     return;
   }
-  if (input) {
-    node_increment_reads(self);
-    self->data.value = input->data.value;
+  if (input != NO_NODE) {
+    node_increment_reads(self, e);
+    nodes->data[self].value = nodes->data[input].value;
     node_broadcast(self, input, e);
   }
   node_finalize(self);
 }
 
-void node_event_equals(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_equals(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
     return;
   }
-  if (input) {
-    u16 reads = node_increment_reads(self);
+  if (input != NO_NODE) {
+    u16 reads = node_increment_reads(self, e);
     if (reads == 1) {
-      self->data.value = input->data.value;
+      nodes->data[self].value = nodes->data[input].value;
     }
     else if (reads == 2) {
-      self->data.value = self->data.value == input->data.value;
-      if (self->data.value != 0) {
+      nodes->data[self].value = nodes->data[self].value == nodes->data[input].value;
+      if (nodes->data[self].value != 0) {
         node_broadcast(self, input, e);
       }
     }
@@ -212,384 +387,951 @@ void node_event_equals(Node* self, Node* input, Engine* e) {
   node_finalize(self);
 }
 
-void node_event_copy_lr(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_copy_lr(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
     return;
   }
-  if (input) {
-    Node* in = node_get_alive_neighbour(e, self, -1, 0);
-    Node* out = node_get_alive_neighbour(e, self, 1, 0);
+  if (input != NO_NODE) {
+    u32 in = e->graph.dir[self][DIR_LEFT];
+    u32 out = e->graph.dir[self][DIR_RIGHT];
     if (in == input) {
-      node_increment_reads(self);
-      self->data.value = input->data.value;
-      if (out) {
-        node_increment_writes(self);
-        out->data.value = self->data.value;
-        node_event_callback(out, self, e);
+      node_increment_reads(self, e);
+      nodes->data[self].value = nodes->data[input].value;
+      if (out != NO_NODE) {
+        node_forward(self, out);
       }
     }
   }
   node_finalize(self);
 }
 
-void node_event_copy_rl(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_copy_rl(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
     return;
   }
-  if (input) {
-    Node* in = node_get_alive_neighbour(e, self, 1, 0);
-    Node* out = node_get_alive_neighbour(e, self, -1, 0);
+  if (input != NO_NODE) {
+    u32 in = e->graph.dir[self][DIR_RIGHT];
+    u32 out = e->graph.dir[self][DIR_LEFT];
     if (in == input) {
-      node_increment_reads(self);
-      self->data.value = input->data.value;
-      if (out) {
-        node_increment_writes(self);
-        out->data.value = self->data.value;
-        node_event_callback(out, self, e);
+      node_increment_reads(self, e);
+      nodes->data[self].value = nodes->data[input].value;
+      if (out != NO_NODE) {
+        node_forward(self, out);
       }
     }
   }
   node_finalize(self);
 }
 
-void node_event_copy_ud(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_copy_ud(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
     return;
   }
-  if (input) {
-    Node* in = node_get_alive_neighbour(e, self, 0, -1);
-    Node* out = node_get_alive_neighbour(e, self, 0, 1);
+  if (input != NO_NODE) {
+    u32 in = e->graph.dir[self][DIR_UP];
+    u32 out = e->graph.dir[self][DIR_DOWN];
     if (in == input) {
-      node_increment_reads(self);
-      self->data.value = input->data.value;
-      if (out) {
-        node_increment_writes(self);
-        out->data.value = self->data.value;
-        node_event_callback(out, self, e);
+      node_increment_reads(self, e);
+      nodes->data[self].value = nodes->data[input].value;
+      if (out != NO_NODE) {
+        node_forward(self, out);
       }
     }
   }
   node_finalize(self);
 }
 
-void node_event_copy_du(Node* self, Node* input, Engine* e) {
-  if (!node_safe_guard(self)) {
+void node_event_copy_du(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
     return;
   }
-  if (input) {
-    Node* in = node_get_alive_neighbour(e, self, 0, 1);
-    Node* out = node_get_alive_neighbour(e, self, 0, -1);
+  if (input != NO_NODE) {
+    u32 in = e->graph.dir[self][DIR_DOWN];
+    u32 out = e->graph.dir[self][DIR_UP];
     if (in == input) {
-      node_increment_reads(self);
-      self->data.value = input->data.value;
-      if (out) {
-        node_increment_writes(self);
-        out->data.value = self->data.value;
-        node_event_callback(out, self, e);
+      node_increment_reads(self, e);
+      nodes->data[self].value = nodes->data[input].value;
+      if (out != NO_NODE) {
+        node_forward(self, out);
       }
     }
   }
   node_finalize(self);
 }
 
-void node_broadcast_event_copy(Node* self, Node* input, Engine* e) {
-  assert(self && input);
-  input->data.value = self->data.value;
+void node_event_delay(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
+    return;
+  }
+  // a click holds the value it set
+  if (input != NO_NODE) {
+    node_increment_reads(self, e);
+    wheel_schedule(e, self, input, nodes->data[input].value);
+  }
+  else {
+    wheel_schedule(e, self, NO_NODE, nodes->data[self].value);
+  }
+  node_finalize(self);
 }
 
-Node* node_from_grid_pos(Engine* e, u32 x, u32 y) {
-  Node* result = NULL;
-  u32 index = y * NODE_GRID_WIDTH + x;
-  if (index < MAX_NODE) {
-    result = &e->state.nodes[index];
+// a click sends its own value
+void node_event_send(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
+    return;
+  }
+  if (input != NO_NODE) {
+    node_increment_reads(self, e);
+    nodes->data[self].value = nodes->data[input].value;
   }
-  return result;
+  // the whole channel costs one write
+  Channel* channel = channels_of(e, self);
+  node_increment_writes(self, e);
+  Event_frame* frame = &event_frames[event_frame_count - 1];
+  assert(frame->self == self);
+  frame->channel = e->channels.group[self];
+  frame->count = channel->receive_count;
+  node_finalize(self);
 }
 
-Result id_to_grid_pos(Node* node, u32* x, u32* y) {
-  Result result = Ok;
-  if (x) {
-    *x = node->id % NODE_GRID_WIDTH;
+// only listens to its channel, what it got from there goes to every neighbour.
+// a click sends its own value
+void node_event_receive(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!node_safe_guard(self, e)) {
+    return;
   }
-  if (y) {
-    *y = node->id / NODE_GRID_WIDTH;
+  if (input == NO_NODE || nodes->type[input] == NODE_SEND) {
+    if (input != NO_NODE) {
+      node_increment_reads(self, e);
+    }
+    node_broadcast(self, NO_NODE, e);
   }
-  return result;
+  node_finalize(self);
 }
 
-Result node_to_grid_pos(Node* node, u32* x, u32* y) {
-  return id_to_grid_pos(node, x, y);
+// what a neighbour writes depends on its side: the address from the left, the
+// data from above and a write of the data to the address from below, when it
+// isn't 0. a new address, or a click, loads its word and sends it to the right
+void node_event_memory(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  u32* dir = e->graph.dir[self];
+  if (!node_safe_guard(self, e)) {
+    return;
+  }
+  Bank* bank = banks_of(e, self);
+  if (!bank) {
+    node_finalize(self);
+    return;
+  }
+  Node_value* words = banks_words(e, bank);
+  u32 load = input == NO_NODE;
+  if (input != NO_NODE) {
+    Node_value value = nodes->data[input].value;
+    if (input == dir[DIR_LEFT]) {
+      node_increment_reads(self, e);
+      bank->address = value & BANK_MASK;
+      load = true;
+    }
+    else if (input == dir[DIR_UP]) {
+      node_increment_reads(self, e);
+      bank->data = value;
+    }
+    else if (input == dir[DIR_DOWN]) {
+      node_increment_reads(self, e);
+      if (value != 0) {
+        words[bank->address] = bank->data;
+      }
+    }
+  }
+  if (load) {
+    nodes->data[self].value = words[bank->address];
+    if (dir[DIR_RIGHT] != NO_NODE) {
+      node_forward(self, dir[DIR_RIGHT]);
+    }
+  }
+  node_finalize(self);
 }
 
-void node_get_alive_neighbours(Engine* e, Node* node, Node* neighbours[MAX_NEIGHBOUR], u32* count) {
-  if (!node) {
+// what comes in on a side runs the body to the end, then every side a signal
+// left it by sends on. a click sends its own value out of every side
+void node_event_macro(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  u32* dir = e->graph.dir[self];
+  if (!node_safe_guard(self, e)) {
     return;
   }
-
-  assert(count != NULL);
-
-  *count = 0;
-  u32 x = 0;
-  u32 y = 0;
-  id_to_grid_pos(node, &x, &y);
-
-  {
-    Node* n = node_from_grid_pos(e, x - 1, y);
-    if (n) {
-      if (n->alive) {
-        neighbours[(*count)++] = n;
-      }
+  Instance* instance = subcircuits_of(e, self);
+  if (!instance) {
+    node_finalize(self);
+    return;
+  }
+  u32 sides = 0;
+  if (input != NO_NODE) {
+    u32 side = 0;
+    while (side < MAX_DIR && dir[side] != input) {
+      ++side;
     }
+    if (side == MAX_DIR) {
+      node_finalize(self);
+      return;
+    }
+    node_increment_reads(self, e);
+    sides = subcircuits_run(e, self, side, nodes->data[input].value, subcircuits_copies(e, input, OPPOSITE(side)), nodes->type[input], instance->out[0]);
   }
-  {
-    Node* n = node_from_grid_pos(e, x + 1, y);
-    if (n) {
-      if (n->alive) {
-        neighbours[(*count)++] = n;
-      }
+  else {
+    for (u32 d = 0; d < MAX_DIR; ++d) {
+      instance->out[0][d] = nodes->data[self].value;
     }
+    sides = (1 << MAX_DIR) - 1;
   }
-  {
-    Node* n = node_from_grid_pos(e, x, y - 1);
-    if (n) {
-      if (n->alive) {
-        neighbours[(*count)++] = n;
-      }
+  for (u32 d = 0; d < MAX_DIR; ++d) {
+    if ((sides & (1 << d)) && dir[d] != NO_NODE) {
+      node_forward(self, dir[d]);
     }
   }
-  {
-    Node* n = node_from_grid_pos(e, x, y + 1);
-    if (n) {
-      if (n->alive) {
-        neighbours[(*count)++] = n;
-      }
+  node_finalize(self);
+}
+
+void node_broadcast_event_copy(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  assert(self != NO_NODE && input != NO_NODE);
+  nodes->data[input].value = nodes->data[self].value;
+}
+
+// a MACRO sends every side the last value that left its body there
+void node_broadcast_event_macro(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Instance* instance = subcircuits_of(e, self);
+  assert(instance && input != NO_NODE);
+  u32 side = 0;
+  while (side < MAX_DIR && e->graph.dir[self][side] != input) {
+    ++side;
+  }
+  if (side == MAX_DIR) {
+    return;
+  }
+  nodes->data[self].value = instance->out[0][side];
+  if (subcircuits_copies(e, self, side)) {
+    nodes->data[input].value = nodes->data[self].value;
+  }
+}
+
+u32 node_from_grid_pos(Engine* e, i32 x, i32 y) {
+  return grid_get(&e->grid, x, y);
+}
+
+// the cell under a point, Err in the padding between cells
+Result node_grid_from_screen_pos(i32 x, i32 y, i32* grid_x, i32* grid_y) {
+  *grid_x = grid_floor_div(x - NODE_PADDING, NODE_WIDTH + NODE_PADDING);
+  *grid_y = grid_floor_div(y - NODE_PADDING, NODE_HEIGHT + NODE_PADDING);
+  Box box = node_box(*grid_x, *grid_y);
+  if (inside_box(&box, x, y)) {
+    return Ok;
+  }
+  return Err;
+}
+
+u32 node_grid_neighbour(Engine* e, u32 id, Direction dir) {
+  i32 x = e->state.nodes.x[id];
+  i32 y = e->state.nodes.y[id];
+  switch (dir) {
+    case DIR_LEFT:
+      return node_from_grid_pos(e, x - 1, y);
+    case DIR_RIGHT:
+      return node_from_grid_pos(e, x + 1, y);
+    case DIR_UP:
+      return node_from_grid_pos(e, x, y - 1);
+    case DIR_DOWN:
+      return node_from_grid_pos(e, x, y + 1);
+    default:
+      assert(0);
+      break;
+  }
+  return NO_NODE;
+}
+
+// refresh the direction slots of a node and the reverse slots of its neighbours
+void node_graph_patch(Engine* e, u32 id) {
+  static const Direction opposite[MAX_DIR] = {
+    [DIR_LEFT]  = DIR_RIGHT,
+    [DIR_RIGHT] = DIR_LEFT,
+    [DIR_UP]    = DIR_DOWN,
+    [DIR_DOWN]  = DIR_UP,
+  };
+  Nodes* nodes = &e->state.nodes;
+  Node_graph* graph = &e->graph;
+  for (u32 dir = 0; dir < MAX_DIR; ++dir) {
+    u32 n = node_grid_neighbour(e, id, dir);
+    graph->dir[id][dir] = (n != NO_NODE && nodes->alive[n]) ? n : NO_NODE;
+    if (n != NO_NODE) {
+      graph->dir[n][opposite[dir]] = nodes->alive[id] ? id : NO_NODE;
     }
   }
+  if (!nodes->alive[id]) {
+    graph->count[id] = 0;
+  }
+  graph->dirty = true;
 }
 
-Node* node_get_alive_neighbour(Engine* e, Node* node, i32 delta_x, i32 delta_y) {
-  Node* result = NULL;
-  u32 x = 0;
-  u32 y = 0;
-  node_to_grid_pos(node, &x, &y);
-  Node* n = node_from_grid_pos(e, x + delta_x, y + delta_y);
-  if (n) {
-    if (n->alive) {
-      result = n;
+void node_graph_compile(Engine* e) {
+  Node_index* index = &e->index;
+  Node_graph* graph = &e->graph;
+  u32 offset = 0;
+  for (u32 i = 0; i < index->alive_count; ++i) {
+    u32 id = index->alive[i];
+    graph->offset[id] = offset;
+    for (u32 dir = 0; dir < MAX_DIR; ++dir) {
+      u32 n = graph->dir[id][dir];
+      if (n != NO_NODE) {
+        graph->ids[offset++] = n;
+      }
     }
+    graph->count[id] = offset - graph->offset[id];
   }
-  return result;
+  graph->dirty = false;
 }
 
-void node_copy(Node* dest, Node* src) {
-  node_reset(dest);
-  dest->type = src->type;
-  dest->data = src->data;
+void node_copy(Nodes* nodes, u32 dest, Node_copy* src) {
+  node_reset(nodes, dest);
+  nodes->type[dest] = src->type;
+  nodes->data[dest] = src->data;
+  nodes->delay[dest] = src->delay;
+  nodes->period[dest] = src->period;
+  nodes->phase[dest] = src->phase;
+  nodes->channel[dest] = src->channel;
+  nodes->body[dest] = src->body;
 }
 
-u32 node_broadcast(Node* self, Node* input, Engine* e) {
-  if (!self->ready) {
+u32 node_broadcast(u32 self, u32 input, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  if (!nodes->ready[self]) {
     return 0;
   }
-  assert(self->type < MAX_NODE_TYPE);
-
-  Node_event* event = &node_events[self->type];
+  assert(nodes->type[self] < MAX_NODE_TYPE);
 
-  u32 count = 0;
-  Node* neighbours[MAX_NEIGHBOUR] = {NULL};
-  assert(self != NULL);
-  node_get_alive_neighbours(e, self, neighbours, &count);
+  Node_graph* graph = &e->graph;
+  u32 count = graph->count[self];
+  u32* neighbours = &graph->ids[graph->offset[self]];
   for (u32 i = 0; i < count; ++i) {
-    Node* n = neighbours[i];
+    u32 n = neighbours[i];
     if (n == input) { // don't loop back
       continue;
     }
-    node_increment_writes(self);
-    if (event->broadcast) {
-      event->broadcast(self, n, e);
-    }
-    node_event_callback(n, self, e);
+    node_forward(self, n);
   }
   return count;
 }
 
-u16 node_increment_writes(Node* self) {
-  u16 writes = ++self->writes;
-  self->color = colors[COLOR_RED];
+// queue a write to target, it is delivered once the current event has returned
+void node_forward(u32 self, u32 target) {
+  assert(event_frame_count > 0);
+  Event_frame* frame = &event_frames[event_frame_count - 1];
+  assert(frame->self == self && frame->count < MAX_NEIGHBOUR);
+  frame->targets[frame->count++] = target;
+}
+
+u16 node_increment_writes(u32 self, Engine* e) {
+  u16 writes = ++e->state.nodes.writes[self];
+  e->node_colors[self] = colors[COLOR_RED];
   return writes;
 }
 
-u16 node_increment_reads(Node* self) {
-  u16 reads = ++self->reads;
-  self->color = colors[COLOR_GREEN];
+u16 node_increment_reads(u32 self, Engine* e) {
+  u16 reads = ++e->state.nodes.reads[self];
+  e->node_colors[self] = colors[COLOR_GREEN];
   return reads;
 }
 
-u32 node_safe_guard(Node* self) {
-  assert(self->type < MAX_NODE_TYPE);
-  Node_event* event = &node_events[self->type];
+u32 node_safe_guard(u32 self, Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  assert(nodes->type[self] < MAX_NODE_TYPE);
+  Node_event* event = &node_events[nodes->type[self]];
   if (event->reads == 0) {
-    return self->ready && self->writes < MAX_WRITES;
+    return nodes->ready[self] && nodes->writes[self] < MAX_WRITES;
   }
-  return self->ready && self->reads < event->reads && self->writes < MAX_WRITES;
+  return nodes->ready[self] && nodes->reads[self] < event->reads && nodes->writes[self] < MAX_WRITES;
 }
 
-u32 node_finalize(Node* self) {
-  assert(self->type < MAX_NODE_TYPE);
-  Node_event* event = &node_events[self->type];
-  if (self->reads >= event->reads || self->writes >= MAX_WRITES) {
-    self->ready = false; // we're done processing this node
-  }
+// the node is finalized once its pending broadcast has been drained
+u32 node_finalize(u32 self) {
+  assert(event_frame_count > 0);
+  Event_frame* frame = &event_frames[event_frame_count - 1];
+  assert(frame->self == self);
+  frame->finalize = true;
   return 0;
 }
 
-void node_init(Node* node, Box box, Node_type type) {
-  node->box = box;
-  node->type = type;
-  memset(&node->data, 0, sizeof(Node_data));
-  node->alive = true;
-  node->reads = 0;
-  node->writes = 0;
-  node->ready = true;
-  node->color = colors[COLOR_BLACK];
-  node->target_color = colors[COLOR_BLACK];
+Box node_box(i32 x, i32 y) {
+  return BOX(NODE_PADDING + x * (NODE_WIDTH + NODE_PADDING), NODE_PADDING + y * (NODE_HEIGHT + NODE_PADDING), NODE_WIDTH, NODE_HEIGHT);
+}
+
+void node_init(Nodes* nodes, u32 id, Node_type type) {
+  nodes->type[id] = type;
+  memset(&nodes->data[id], 0, sizeof(Node_data));
+  nodes->alive[id] = true;
+  nodes->reads[id] = 0;
+  nodes->writes[id] = 0;
+  nodes->ready[id] = true;
+  nodes->delay[id] = NODE_DEFAULT_DELAY;
+  nodes->period[id] = CLOCK_DEFAULT_PERIOD;
+  nodes->phase[id] = 0;
+  nodes->channel[id] = 0;
+  nodes->body[id] = 0;
 }
 
-void node_reset(Node* node) {
-  node_init(node, node->box, node->type);
+// a MACRO keeps the body it runs
+void node_reset(Nodes* nodes, u32 id) {
+  u32 body = nodes->body[id];
+  node_init(nodes, id, nodes->type[id]);
+  nodes->body[id] = body;
 }
 
-void node_clear(Node* node) {
-  node_init(node, node->box, NODE_NONE);
+void node_clear(Nodes* nodes, u32 id) {
+  node_init(nodes, id, NODE_NONE);
 }
 
 void node_grid_init(State* state) {
-  const u32 PADDING = 2;
-  const u32 NODE_WIDTH = 38;
-  const u32 NODE_HEIGHT = 38;
-  for (u32 y = 0; y < NODE_GRID_HEIGHT; ++y) {
-    for (u32 x = 0; x < NODE_GRID_WIDTH; ++x) {
-      Node* node = &state->nodes[y * NODE_GRID_WIDTH + x];
-      node_init(node, BOX(PADDING + x * (NODE_WIDTH + PADDING), PADDING + y * (NODE_HEIGHT + PADDING), NODE_WIDTH, NODE_HEIGHT), NODE_NONE);
-      node->alive = false;
-      node->id = y * NODE_GRID_WIDTH + x;
+  Nodes* nodes = &state->nodes;
+  for (u32 id = 0; id < nodes->max_node; ++id) {
+    node_init(nodes, id, NODE_NONE);
+    nodes->alive[id] = false;
+    nodes->x[id] = id % nodes->grid_width;
+    nodes->y[id] = id / nodes->grid_width;
+  }
+}
+
+void nodes_alloc(Nodes* nodes, Arena* arena, u32 grid_width, u32 grid_height) {
+  u32 max_node = grid_width * grid_height;
+  nodes->grid_width = grid_width;
+  nodes->grid_height = grid_height;
+  nodes->max_node = max_node;
+  nodes->type = arena_alloc(arena, sizeof(u8) * max_node);
+  nodes->data = arena_alloc(arena, sizeof(Node_data) * max_node);
+  nodes->alive = arena_alloc(arena, sizeof(u8) * max_node);
+  nodes->reads = arena_alloc(arena, sizeof(u8) * max_node);
+  nodes->writes = arena_alloc(arena, sizeof(u8) * max_node);
+  nodes->ready = arena_alloc(arena, sizeof(u8) * max_node);
+  nodes->x = arena_alloc(arena, sizeof(i32) * max_node);
+  nodes->y = arena_alloc(arena, sizeof(i32) * max_node);
+  nodes->delay = arena_alloc(arena, sizeof(u32) * max_node);
+  nodes->period = arena_alloc(arena, sizeof(u32) * max_node);
+  nodes->phase = arena_alloc(arena, sizeof(u32) * max_node);
+  nodes->channel = arena_alloc(arena, sizeof(u32) * max_node);
+  nodes->body = arena_alloc(arena, sizeof(u32) * max_node);
+}
+
+void node_index_alloc(Engine* e, Arena* arena) {
+  u32 max_node = e->state.nodes.max_node;
+  Node_index* index = &e->index;
+  Node_graph* graph = &e->graph;
+  index->alive = arena_alloc(arena, sizeof(u32) * max_node);
+  index->clocks = arena_alloc(arena, sizeof(u32) * max_node);
+  index->channel_nodes = arena_alloc(arena, sizeof(u32) * max_node);
+  index->not_ready = arena_alloc(arena, sizeof(u32) * max_node);
+  index->not_ready_listed = arena_alloc(arena, sizeof(u8) * max_node);
+  graph->dir = arena_alloc(arena, sizeof(u32[MAX_DIR]) * max_node);
+  graph->offset = arena_alloc(arena, sizeof(u32) * max_node);
+  graph->count = arena_alloc(arena, sizeof(u8) * max_node);
+  graph->ids = arena_alloc(arena, sizeof(u32) * max_node * MAX_NEIGHBOUR);
+  // the frame stack is shared by every engine, a counting arena leaves it be. a
+  // node can only be re-entered while its own broadcast is in progress, and every
+  // re-entry costs it one write, so there are at most MAX_WRITES frames per node
+  Event_frame* frames = arena_alloc(arena, sizeof(Event_frame) * max_node * MAX_WRITES);
+  if (frames) {
+    event_frames = frames;
+    event_frame_count = 0;
+    max_event_frame = max_node * MAX_WRITES;
+  }
+}
+
+u32 node_place(Engine* e, i32 x, i32 y) {
+  Nodes* nodes = &e->state.nodes;
+  u32 id = node_from_grid_pos(e, x, y);
+  if (id != NO_NODE) {
+    return id;
+  }
+  // the id of the cell in the home window, otherwise the last free one so the
+  // home ids stay free for as long as possible
+  if (x >= 0 && y >= 0 && (u32)x < nodes->grid_width && (u32)y < nodes->grid_height && !nodes->alive[y * nodes->grid_width + x]) {
+    id = y * nodes->grid_width + x;
+  }
+  else {
+    for (u32 i = nodes->max_node; i > 0; --i) {
+      if (!nodes->alive[i - 1]) {
+        id = i - 1;
+        break;
+      }
     }
   }
+  if (id == NO_NODE) {
+    signal_engine_log(e, "error", "all %u nodes are in use", nodes->max_node);
+    return NO_NODE;
+  }
+  if (grid_set(&e->grid, x, y, id) != Ok) {
+    return NO_NODE;
+  }
+  node_clear(nodes, id);
+  nodes->x[id] = x;
+  nodes->y[id] = y;
+  return id;
 }
 
-void nodes_update_and_render(Engine* e) {
-  const f32 bps = e->state.bpm / 60.0f;
-  u32 beat = 0;
-  if (e->state.timer >= (1.0f / bps)) {
-    beat = 1;
-    e->state.timer = e->state.timer - (1.0f / bps);
+void node_remove(Engine* e, u32 id) {
+  Nodes* nodes = &e->state.nodes;
+  if (!nodes->alive[id]) {
+    return;
   }
-  Node* hover = NULL;
-  Camera* camera = &e->state.camera;
+  grid_clear(&e->grid, nodes->x[id], nodes->y[id]);
+  node_clear(nodes, id);
+  nodes->alive[id] = false;
+  node_index_update(e, id);
+}
 
-  // make nodes ready
-  for (u32 i = 0; i < MAX_NODE; ++i) {
-    Node* node = &e->state.nodes[i];
-    if (!node->ready && beat) {
-      node->ready = true;
-      node->reads = 0;
-      node->writes = 0;
+u32 node_at_home(Nodes* nodes, u32 id) {
+  i32 x = nodes->x[id];
+  i32 y = nodes->y[id];
+  return x >= 0 && y >= 0 && (u32)x < nodes->grid_width && (u32)y < nodes->grid_height && (u32)y * nodes->grid_width + (u32)x == id;
+}
+
+// binary search for the insertion point, lists are kept sorted by id so clocks
+// fire in the same order as a scan over the grid would
+void node_list_insert(u32* list, u32* count, u32 id) {
+  u32 low = 0;
+  u32 high = *count;
+  while (low < high) {
+    u32 mid = (low + high) / 2;
+    if (list[mid] < id) {
+      low = mid + 1;
+    }
+    else {
+      high = mid;
     }
   }
+  if (low < *count && list[low] == id) {
+    return;
+  }
+  memmove(&list[low + 1], &list[low], (*count - low) * sizeof(u32));
+  list[low] = id;
+  *count += 1;
+}
 
-  // process nodes
-  for (u32 i = 0; i < MAX_NODE; ++i) {
-    Node* node = &e->state.nodes[i];
-    if (inside_box(&node->box, mouse_x + camera->x, mouse_y + camera->y)) {
-      if (mouse_pressed[MOUSE_BUTTON_RIGHT]) {
-        continue;
-      }
-      hover = node;
+void node_list_remove(u32* list, u32* count, u32 id) {
+  u32 low = 0;
+  u32 high = *count;
+  while (low < high) {
+    u32 mid = (low + high) / 2;
+    if (list[mid] < id) {
+      low = mid + 1;
+    }
+    else {
+      high = mid;
     }
-    if (!node->alive) {
+  }
+  if (low >= *count || list[low] != id) {
+    return;
+  }
+  memmove(&list[low], &list[low + 1], (*count - low - 1) * sizeof(u32));
+  *count -= 1;
+}
+
+void node_index_rebuild(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  grid_destroy(&e->grid);
+  for (u32 i = 0; i < nodes->max_node; ++i) {
+    if (!nodes->alive[i]) {
       continue;
     }
-    if (key_pressed[KEY_Q]) {
-      node_reset(node);
+    u32 other = grid_get(&e->grid, nodes->x[i], nodes->y[i]);
+    if (other != NO_NODE) {
+      log_error("node_index_rebuild: node %u is placed on top of node %u, dropping it\n", i, other);
+      nodes->alive[i] = false;
       continue;
     }
-    if (beat && node->type == NODE_CLOCK) {
-      node->ready = true;
-      node_event_callback(node, NULL, e);
+    if (grid_set(&e->grid, nodes->x[i], nodes->y[i], i) != Ok) {
+      nodes->alive[i] = false;
+    }
+  }
+  index->alive_count = 0;
+  index->clock_count = 0;
+  index->channel_node_count = 0;
+  index->not_ready_count = 0;
+  for (u32 i = 0; i < nodes->max_node; ++i) {
+    if (nodes->alive[i]) {
+      index->alive[index->alive_count++] = i;
+      if (nodes->type[i] == NODE_CLOCK) {
+        index->clocks[index->clock_count++] = i;
+      }
+      if (nodes->type[i] == NODE_SEND || nodes->type[i] == NODE_RECEIVE) {
+        index->channel_nodes[index->channel_node_count++] = i;
+      }
+    }
+    index->not_ready_listed[i] = !nodes->ready[i];
+    if (!nodes->ready[i]) {
+      index->not_ready[index->not_ready_count++] = i;
+    }
+  }
+  Node_graph* graph = &e->graph;
+  // free ids get their neighbours when a node is placed on them
+  for (u32 i = 0; i < nodes->max_node; ++i) {
+    for (u32 dir = 0; dir < MAX_DIR; ++dir) {
+      u32 n = nodes->alive[i] ? node_grid_neighbour(e, i, dir) : NO_NODE;
+      graph->dir[i][dir] = n;
+    }
+    graph->count[i] = 0;
+  }
+  node_graph_compile(e);
+  sync_reset(e);
+  wheel_clear(e);
+  clocks_reset(e);
+  banks_rebuild(e);
+  subcircuits_rebuild(e);
+  analysis_touch(e, NO_NODE);
+  index->generation++;
+}
+
+void node_index_update(Engine* e, u32 id) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  if (nodes->alive[id]) {
+    node_list_insert(index->alive, &index->alive_count, id);
+  }
+  else {
+    node_list_remove(index->alive, &index->alive_count, id);
+  }
+  if (nodes->alive[id] && nodes->type[id] == NODE_CLOCK) {
+    node_list_insert(index->clocks, &index->clock_count, id);
+  }
+  else {
+    node_list_remove(index->clocks, &index->clock_count, id);
+  }
+  if (nodes->alive[id] && (nodes->type[id] == NODE_SEND || nodes->type[id] == NODE_RECEIVE)) {
+    node_list_insert(index->channel_nodes, &index->channel_node_count, id);
+  }
+  else {
+    node_list_remove(index->channel_nodes, &index->channel_node_count, id);
+  }
+  node_graph_patch(e, id);
+  sync_reset_node(e, id);
+  wheel_cancel(e, id);
+  banks_update(e, id);
+  subcircuits_update(e, id);
+  analysis_touch(e, id);
+  index->generation++;
+}
+
+void nodes_simulate_beat(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  wheel_advance(e);
+  clocks_advance(e);
+  subcircuits_ready(e);
+  if (e->state.mode != SIM_MODE_CASCADE) {
+    sync_simulate_beat(e);
+    return;
+  }
+  sync_touch(e);
+  // make nodes ready
+  for (u32 i = 0; i < index->not_ready_count; ++i) {
+    u32 id = index->not_ready[i];
+    index->not_ready_listed[id] = false;
+    if (!nodes->ready[id]) {
+      nodes->ready[id] = true;
+      nodes->reads[id] = 0;
+      nodes->writes[id] = 0;
+    }
+  }
+  index->not_ready_count = 0;
+  if (e->prune) {
+    analysis_update(e);
+  }
+
+  assert(e->sim_engine < MAX_SIM_ENGINE);
+  sim_engine_beats[e->sim_engine](e);
+}
+
+void nodes_trigger_clocks(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Wheel* wheel = &e->wheel;
+  Clocks* clocks = &e->clocks;
+  for (u32 i = 0; i < wheel->due_count; ++i) {
+    Wheel_entry* entry = &wheel->due[i];
+    node_event_release(e, entry->node, entry->input, entry->value);
+  }
+  for (u32 i = 0; i < clocks->due_count; ++i) {
+    u32 id = clocks->due[i];
+    if (e->prune && !e->analysis.live[id]) {
+      continue;
+    }
+    nodes->ready[id] = true;
+    node_event_callback(id, NO_NODE, e);
+  }
+}
+
+u32 nodes_run_beats(Engine* e) {
+  State* state = &e->state;
+  u32 beats = 0;
+  if (state->paused) {
+    return 0;
+  }
+  if (e->max_speed) {
+    // reading the clock costs about as much as a small beat, so only every few beats
+    const u32 BEATS_PER_CHECK = 16;
+    TIMER_START();
+    u32 cap = e->beat_cap != 0 ? e->beat_cap : (u32)-1;
+    do {
+      for (u32 i = 0; i < BEATS_PER_CHECK && beats < cap; ++i, ++beats) {
+        nodes_simulate_beat(e);
+      }
+    } while (beats < cap && TIMER_END() < e->beat_budget);
+    state->timer = 0.0f;
+    return beats;
+  }
+  if (state->bpm <= 0.0f) {
+    state->timer = 0.0f;
+    return 0;
+  }
+
+  const f64 period = 60.0 / state->bpm;
+  f64 due = floor(state->timer / period);
+  f64 timer = state->timer - due * period;
+  if (e->beat_cap != 0 && due > e->beat_cap) {
+    // drop the backlog instead of carrying it, or a circuit slower than the bpm
+    // would fall further behind every frame
+    due = e->beat_cap;
+  }
+  state->timer = timer;
+  beats = (u32)due;
+  if (state->mode == SIM_MODE_SYNC && e->hashlife && beats > 1) {
+    if (hashlife_advance(e, beats) == Ok) {
+      return beats;
+    }
+    // don't pay for a failed attempt every frame
+    e->hashlife = false;
+    signal_engine_log(e, "info", "hashlife: not usable for this circuit");
+  }
+  for (u32 i = 0; i < beats; ++i) {
+    nodes_simulate_beat(e);
+  }
+  return beats;
+}
+
+void nodes_update_and_render(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Camera* camera = &e->state.camera;
+
+  if (key_pressed[KEY_Q]) {
+    for (u32 i = 0; i < e->index.alive_count; ++i) {
+      node_reset(nodes, e->index.alive[i]);
+    }
+    sync_reset(e);
+    e->frame_beats = 0;
+  }
+  else {
+    e->frame_beats = nodes_run_beats(e);
+  }
+
+  u32 hover = NO_NODE;
+  i32 hover_x = 0;
+  i32 hover_y = 0;
+  if (!mouse_pressed[MOUSE_BUTTON_RIGHT] && node_grid_from_screen_pos(mouse_x + camera->x, mouse_y + camera->y, &hover_x, &hover_y) == Ok) {
+    hover = node_from_grid_pos(e, hover_x, hover_y);
+    // B on one corner and then on the other captures the region as a subcircuit
+    if (!key_mod_ctrl && key_pressed[KEY_B]) {
+      if (!marked) {
+        mark_x = hover_x;
+        mark_y = hover_y;
+        signal_engine_log(e, "info", "marked %d, %d", hover_x, hover_y);
+      }
+      else {
+        subcircuits_capture(e, mark_x, mark_y, hover_x, hover_y);
+      }
+      marked = !marked;
+    }
+    // edits that put a node in an empty cell
+    u32 paste = key_mod_ctrl && key_pressed[KEY_V] && copy;
+    u32 scroll = !key_mod_ctrl && mouse_scroll_y != 0;
+    if (hover == NO_NODE && (key_pressed[KEY_R] || paste || scroll)) {
+      hover = node_place(e, hover_x, hover_y);
     }
   }
 
-  if (hover) {
-    if (mouse_pressed[MOUSE_BUTTON_LEFT]) {
-      hover->data.value = 1;
-      node_event_callback(hover, NULL, e);
+  if (hover != NO_NODE) {
+    if (mouse_pressed[MOUSE_BUTTON_LEFT] && nodes->alive[hover]) {
+      if (e->state.mode != SIM_MODE_CASCADE) {
+        nodes->data[hover].value = 1;
+        sync_fire(e, hover);
+      }
+      else {
+        nodes->data[hover].value = 1;
+        node_event_callback(hover, NO_NODE, e);
+      }
     }
     if (key_pressed[KEY_R]) {
-      node_reset(hover);
+      node_reset(nodes, hover);
+      node_index_update(e, hover);
     }
     if (key_mod_ctrl) {
       if (key_pressed[KEY_C]) {
         copy = &copy_data;
-        memcpy(copy, hover, sizeof(Node));
-        signal_engine_log(e, "info", "copied node %u", hover->id);
+        copy->type = nodes->type[hover];
+        copy->data = nodes->data[hover];
+        copy->delay = nodes->delay[hover];
+        copy->period = nodes->period[hover];
+        copy->phase = nodes->phase[hover];
+        copy->channel = nodes->channel[hover];
+        copy->body = nodes->body[hover];
+        copy->id = hover;
+        signal_engine_log(e, "info", "copied node %u", hover);
       }
       if (key_pressed[KEY_X]) {
         copy = &copy_data;
-        memcpy(copy, hover, sizeof(Node));
-        node_clear(hover);
-        hover->alive = false;
-        signal_engine_log(e, "info", "cut node %u", hover->id);
+        copy->type = nodes->type[hover];
+        copy->data = nodes->data[hover];
+        copy->delay = nodes->delay[hover];
+        copy->period = nodes->period[hover];
+        copy->phase = nodes->phase[hover];
+        copy->channel = nodes->channel[hover];
+        copy->body = nodes->body[hover];
+        copy->id = hover;
+        node_remove(e, hover);
+        signal_engine_log(e, "info", "cut node %u", hover);
       }
       if (key_pressed[KEY_V]) {
         if (copy) {
-          node_copy(hover, copy);
+          node_copy(nodes, hover, copy);
+          node_index_update(e, hover);
           signal_engine_log(e, "info", "pasted node %u", copy->id);
         }
       }
-      if (mouse_scroll_y > 0) {
-        hover->data.value += 1;
+      if (mouse_scroll_y != 0) {
+        sync_touch(e);
+      }
+      // a SEND or RECEIVE scrolls its channel instead, which rewires it
+      if ((nodes->type[hover] == NODE_SEND || nodes->type[hover] == NODE_RECEIVE) && mouse_scroll_y != 0) {
+        if (mouse_scroll_y > 0) {
+          nodes->channel[hover] += 1;
+        }
+        else if (nodes->channel[hover] > 0) {
+          nodes->channel[hover] -= 1;
+        }
+        node_index_update(e, hover);
+      }
+      // a MACRO its subcircuit, it starts over from the captured values
+      else if (nodes->type[hover] == NODE_MACRO && mouse_scroll_y != 0) {
+        u32 count = e->subcircuits.body_count;
+        if (count > 0) {
+          nodes->body[hover] = (nodes->body[hover] % count + (mouse_scroll_y > 0 ? 1 : count - 1)) % count;
+          node_index_update(e, hover);
+        }
+      }
+      // a CLOCK its period, or with shift its phase
+      else if (nodes->type[hover] == NODE_CLOCK && mouse_scroll_y != 0) {
+        u32* field = key_mod_shift ? &nodes->phase[hover] : &nodes->period[hover];
+        u32 min = key_mod_shift ? 0 : 1;
+        if (mouse_scroll_y > 0) {
+          *field += 1;
+        }
+        else if (*field > min) {
+          *field -= 1;
+        }
+        if (nodes->period[hover] > 0) {
+          nodes->phase[hover] %= nodes->period[hover];
+        }
+        clocks_touch(e);
+      }
+      // a DELAY its delay, what it holds keeps its due beat
+      else if (nodes->type[hover] == NODE_DELAY) {
+        if (mouse_scroll_y > 0) {
+          nodes->delay[hover] += 1;
+        }
+        else if (mouse_scroll_y < 0 && nodes->delay[hover] > 1) {
+          nodes->delay[hover] -= 1;
+        }
+      }
+      else if (mouse_scroll_y > 0) {
+        nodes->data[hover].value += 1;
       }
       else if (mouse_scroll_y < 0) {
-        hover->data.value -= 1;
+        nodes->data[hover].value -= 1;
       }
     }
     else {
       if (mouse_scroll_y > 0) {
-        node_reset(hover);
-        hover->type = (hover->type + 1) % MAX_NODE_TYPE;
+        node_reset(nodes, hover);
+        nodes->type[hover] = (nodes->type[hover] + 1) % MAX_NODE_TYPE;
       }
       else if (mouse_scroll_y < 0) {
-        node_reset(hover);
-        if (hover->type == 0) {
-          hover->type = MAX_NODE_TYPE - 1;
+        node_reset(nodes, hover);
+        if (nodes->type[hover] == 0) {
+          nodes->type[hover] = MAX_NODE_TYPE - 1;
         }
         else {
-          hover->type -= 1;
+          nodes->type[hover] -= 1;
         }
       }
+      if (mouse_scroll_y != 0) {
+        node_index_update(e, hover);
+      }
     }
   }
 
-  // and finally render them
-  for (u32 i = 0; i < MAX_NODE; ++i) {
-    Node* node = &e->state.nodes[i];
-    if (!node->alive) {
-      render_rect(node->box.x - camera->x, node->box.y - camera->y, node->box.w, node->box.h, BORDER_THICKNESS, node->color);
-      continue;
-    }
-    node->color = color_lerp(node->color, node->target_color, e->state.dt * 10.0f);
+  // and finally render the visible part of the grid
+  u32 width = 0;
+  u32 height = 0;
+  platform_window_size(&width, &height);
+  i32 cell_width = NODE_WIDTH + NODE_PADDING;
+  i32 cell_height = NODE_HEIGHT + NODE_PADDING;
+  i32 min_x = grid_floor_div((i32)camera->x, cell_width) - 1;
+  i32 min_y = grid_floor_div((i32)camera->y, cell_height) - 1;
+  i32 max_x = grid_floor_div((i32)camera->x + (i32)width, cell_width) + 1;
+  i32 max_y = grid_floor_div((i32)camera->y + (i32)height, cell_height) + 1;
+  for (i32 y = min_y; y <= max_y; ++y) {
+    for (i32 x = min_x; x <= max_x; ++x) {
+      u32 i = node_from_grid_pos(e, x, y);
+      Box box = node_box(x, y);
+      if (i == NO_NODE) {
+        render_rect(box.x - camera->x, box.y - camera->y, box.w, box.h, BORDER_THICKNESS, colors[COLOR_BLACK]);
+        continue;
+      }
+      u32* color = &e->node_colors[i];
+      *color = color_lerp(*color, colors[COLOR_BLACK], e->state.dt * 10.0f);
 
-    if (node == hover) {
-      node->color = color_lerp(node->target_color, colors[COLOR_WHITE], 1.0f);
+      if (i == hover) {
+        *color = colors[COLOR_WHITE];
+      }
+      render_sprite_from_id(box.x - camera->x, box.y - camera->y, box.w, box.h, (Sprite_id)nodes->type[i]);
+      if (nodes->type[i] == NODE_DELAY) {
+        render_text_format(box.x - camera->x + BORDER_THICKNESS * 2, box.y - camera->y + BORDER_THICKNESS * 2, DEFAULT_GLYPH_SIZE, colors[COLOR_WHITE], "%u", nodes->delay[i]);
+      }
+      else if (nodes->type[i] == NODE_SEND || nodes->type[i] == NODE_RECEIVE) {
+        render_text_format(box.x - camera->x + BORDER_THICKNESS * 2, box.y - camera->y + BORDER_THICKNESS * 2, DEFAULT_GLYPH_SIZE, colors[COLOR_WHITE], "%u", nodes->channel[i]);
+      }
+      else if (nodes->type[i] == NODE_MACRO) {
+        render_text_format(box.x - camera->x + BORDER_THICKNESS * 2, box.y - camera->y + BORDER_THICKNESS * 2, DEFAULT_GLYPH_SIZE, colors[COLOR_WHITE], "%u", nodes->body[i]);
+      }
+      else if (nodes->type[i] == NODE_CLOCK && nodes->period[i] > 1) {
+        render_text_format(box.x - camera->x + BORDER_THICKNESS * 2, box.y - camera->y + BORDER_THICKNESS * 2, 1, colors[COLOR_WHITE], "%u", nodes->period[i]);
+      }
+      render_rect(box.x - camera->x, box.y - camera->y, box.w, box.h, BORDER_THICKNESS, *color);
     }
-    render_sprite_from_id(node->box.x - camera->x, node->box.y - camera->y, node->box.w, node->box.h, (Sprite_id)node->type);
-    render_rect(node->box.x - camera->x, node->box.y - camera->y, node->box.w, node->box.h, BORDER_THICKNESS, node->color);
+  }
+  if (marked) {
+    Box box = node_box(mark_x, mark_y);
+    render_rect(box.x - camera->x, box.y - camera->y, box.w, box.h, BORDER_THICKNESS, colors[COLOR_YELLOW]);
   }
 
   node_render_info_box(e, hover);
 }
 
-void node_render_info_box(Engine* e, Node* node) {
+void node_render_info_box(Engine* e, u32 node) {
+  Nodes* nodes = &e->state.nodes;
   u32 width = 0;
   u32 height = 0;
   u32 glyph_size = DEFAULT_GLYPH_SIZE;
@@ -605,8 +1347,8 @@ void node_render_info_box(Engine* e, Node* node) {
 #define Y_PLACE_GET(OFFSET) (y = (placement_count * glyph_spacing) + OFFSET)
 
   if (e->show_info_box) {
-    if (node) {
-      if (node->alive) {
+    if (node != NO_NODE) {
+      if (nodes->alive[node]) {
         u32 y_pos = Y_PLACE(0);
         render_fill_rect(0, y_pos, width, glyph_spacing, colors[COLOR_BLACK]);
         render_text_format(
@@ -615,15 +1357,118 @@ void node_render_info_box(Engine* e, Node* node) {
           glyph_size,
           colors[COLOR_WHITE],
           "type: %s, "
-          "value: %u, "
+          "value: " NODE_VALUE_FMT ", "
           "reads: %u, "
           "writes: %u"
           ,
-          node_type_str[node->type],
-          node->data.value,
-          node->reads,
-          node->writes
+          node_type_str[nodes->type[node]],
+          nodes->data[node].value,
+          nodes->reads[node],
+          nodes->writes[node]
+        );
+        analysis_update(e);
+        Component* component = &e->analysis.components[e->analysis.component[node]];
+        y_pos = Y_PLACE(0);
+        render_fill_rect(0, y_pos, width, glyph_spacing, colors[COLOR_BLACK]);
+        render_text_format(
+          padding,
+          y_pos + padding,
+          glyph_size,
+          colors[COLOR_WHITE],
+          "component: %u, "
+          "nodes: %u, "
+          "clocks: %u, "
+          "live: %u"
+          ,
+          e->analysis.component[node],
+          component->count,
+          component->clock_count,
+          component->live_count
         );
+        if (nodes->type[node] == NODE_DELAY) {
+          y_pos = Y_PLACE(0);
+          render_fill_rect(0, y_pos, width, glyph_spacing, colors[COLOR_BLACK]);
+          render_text_format(
+            padding,
+            y_pos + padding,
+            glyph_size,
+            colors[COLOR_WHITE],
+            "delay: %u"
+            ,
+            nodes->delay[node]
+          );
+        }
+        if (nodes->type[node] == NODE_SEND || nodes->type[node] == NODE_RECEIVE) {
+          channels_update(e);
+          Channel* channel = channels_of(e, node);
+          y_pos = Y_PLACE(0);
+          render_fill_rect(0, y_pos, width, glyph_spacing, colors[COLOR_BLACK]);
+          render_text_format(
+            padding,
+            y_pos + padding,
+            glyph_size,
+            colors[COLOR_WHITE],
+            "channel: %u, "
+            "sends: %u, "
+            "receives: %u"
+            ,
+            nodes->channel[node],
+            channel->send_count,
+            channel->receive_count
+          );
+        }
+        if (nodes->type[node] == NODE_MEMORY && banks_of(e, node)) {
+          Bank* bank = banks_of(e, node);
+          y_pos = Y_PLACE(0);
+          render_fill_rect(0, y_pos, width, glyph_spacing, colors[COLOR_BLACK]);
+          render_text_format(
+            padding,
+            y_pos + padding,
+            glyph_size,
+            colors[COLOR_WHITE],
+            "address: %u, "
+            "data: " NODE_VALUE_FMT ", "
+            "word: " NODE_VALUE_FMT
+            ,
+            bank->address,
+            (Node_value)bank->data,
+            banks_words(e, bank)[bank->address]
+          );
+        }
+        if (nodes->type[node] == NODE_MACRO && subcircuits_of(e, node)) {
+          Body* body = &e->subcircuits.bodies[nodes->body[node]];
+          y_pos = Y_PLACE(0);
+          render_fill_rect(0, y_pos, width, glyph_spacing, colors[COLOR_BLACK]);
+          render_text_format(
+            padding,
+            y_pos + padding,
+            glyph_size,
+            colors[COLOR_WHITE],
+            "subcircuit: %u, "
+            "size: %ux%u, "
+            "nodes: %u"
+            ,
+            nodes->body[node],
+            body->width,
+            body->height,
+            body->count
+          );
+        }
+        if (nodes->type[node] == NODE_CLOCK) {
+          y_pos = Y_PLACE(0);
+          render_fill_rect(0, y_pos, width, glyph_spacing, colors[COLOR_BLACK]);
+          render_text_format(
+            padding,
+            y_pos + padding,
+            glyph_size,
+            colors[COLOR_WHITE],
+            "period: %u, "
+            "phase: %u"
+            ,
+            nodes->period[node],
+            nodes->phase[node]
+          );
+        }
       }
     }
     if (copy) {
@@ -97,6 +97,7 @@ static const i32 KEY_MAP_SIZE = (sizeof(key_map) / sizeof(key_map[0]));
 u8 key_down[KEY_MAP_SIZE] = {0};
 u8 key_pressed[KEY_MAP_SIZE] = {0};
 u32 key_mod_ctrl = false;
+u32 key_mod_shift = false;
 
 i32 mouse_x = INT32_MAX;
 i32 mouse_y = INT32_MAX;
@@ -199,6 +200,7 @@ Result platform_pollevents() {
 
   SDL_Keymod key_mod = SDL_GetModState();
   key_mod_ctrl = (key_mod & KMOD_LCTRL) == KMOD_LCTRL;
+  key_mod_shift = (key_mod & KMOD_LSHIFT) == KMOD_LSHIFT;
 
   SDL_Event event;
   while (SDL_PollEvent(&event)) {
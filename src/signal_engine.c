@@ -8,11 +8,67 @@
 #include "platform.c"
 #include "renderer.c"
 #include "node.c"
+#include "grid.c"
+#include "analysis.c"
+#include "wheel.c"
+#include "clocks.c"
+#include "channels.c"
+#include "banks.c"
+#include "subcircuits.c"
+#include "netlist.c"
+#include "codegen.c"
+#include "tiles.c"
+#include "sync.c"
+#include "bitslice.c"
+#include "batch.c"
+#include "cycle.c"
+#include "hashlife.c"
 #include "camera.c"
 
-#define MAX_TITLE_LENGTH 64
+#define MAX_TITLE_LENGTH 96
 #define PROG_NAME "Signal Engine"
 #define BPM 120.0f
+#define BEAT_CAP 10000
+#define BEAT_BUDGET 0.012f // leaves some of a 60 fps frame for input and rendering
+
+#define STATE_MAGIC 0x45474953 // "SIGE"
+#define STATE_VERSION 9
+
+typedef struct {
+  u32 magic;
+  u32 version;
+  u32 grid_width;
+  u32 grid_height;
+} State_header;
+
+// layout of state files written before the header was introduced, where the
+// whole state was one packed array of nodes
+typedef struct {
+  Box box;
+  Node_type type;
+  u16 value;
+  u16 alive;
+  u16 reads;
+  u16 writes;
+  u16 ready;
+  u16 id;
+  u32 color;
+  u32 target_color;
+} __attribute__((packed, aligned(sizeof(u32)))) Node_v0;
+
+// the grid every state file had before the dimensions were stored
+#define V0_GRID_WIDTH 64
+#define V0_GRID_HEIGHT 64
+
+typedef struct {
+  f32 dt;
+  f32 timer;
+  f32 bpm;
+  u32 tick;
+  u32 paused;
+  Camera camera;
+  Node_v0 nodes[V0_GRID_WIDTH * V0_GRID_HEIGHT];
+} __attribute__((packed, aligned(sizeof(u32)))) State_v0;
 
 i32 saved_mouse_x = 0;
 i32 saved_mouse_y = 0;
@@ -24,48 +80,379 @@ u32 log_entry_count = 0;
 u32 log_head = 0;
 
 static void signal_state_init(State* state);
+static Result signal_state_alloc(State* state, Arena* arena, u32 grid_width, u32 grid_height, u32 huge_pages);
+static Result signal_engine_create(Engine* e, u32 grid_width, u32 grid_height, u32 huge_pages);
+static void signal_engine_destroy(Engine* e);
+static Result signal_engine_alloc(Engine* e);
+static void signal_engine_carve(Engine* e, Arena* arena);
 static void signal_engine_init(Engine* state);
+static void signal_engine_run_headless(Engine* e, u32 beats, u32 fast_forward);
+static Result signal_engine_run_batch(Engine* e, u32 beats, u32 lanes, i32 sweep);
+static Result state_field(Buffer* buffer, void* data, u32 size, u32* iter, u32 write);
+static Result state_values(Buffer* buffer, Nodes* nodes, u32 bits, u32* iter);
+static Result state_serialize(Buffer* buffer, State* state, u32 version, u32* iter, u32 write);
+static void state_from_v0(State* state, State_v0* v0);
 
 void signal_state_init(State* state) {
   state->dt = 0.0f;
   state->timer = 0.0f;
   state->bpm = BPM;
   state->paused = false;
+  state->mode = SIM_MODE_CASCADE;
   camera_init(&state->camera);
   node_grid_init(state);
   log_entry_count = 0;
 }
 
+// the node arrays of a state, in an arena of their own so a loaded state can
+// replace them as a whole
+Result signal_state_alloc(State* state, Arena* arena, u32 grid_width, u32 grid_height, u32 huge_pages) {
+  Arena measure = {0};
+  nodes_alloc(&state->nodes, &measure, grid_width, grid_height);
+  if (arena_init(arena, measure.used, huge_pages) != Ok) {
+    return Err;
+  }
+  nodes_alloc(&state->nodes, arena, grid_width, grid_height);
+  return Ok;
+}
+
+Result signal_engine_create(Engine* e, u32 grid_width, u32 grid_height, u32 huge_pages) {
+  e->huge_pages = huge_pages;
+  e->wheel = (Wheel) {0};
+  wheel_clear(e);
+  e->banks = (Banks) {0};
+  e->subcircuits = (Subcircuits) {0};
+  if (signal_state_alloc(&e->state, &e->state_arena, grid_width, grid_height, huge_pages) != Ok) {
+    return Err;
+  }
+  if (signal_engine_alloc(e) != Ok) {
+    arena_free(&e->state_arena);
+    return Err;
+  }
+  signal_engine_init(e);
+  return Ok;
+}
+
+void signal_engine_destroy(Engine* e) {
+  grid_destroy(&e->grid);
+  wheel_destroy(e);
+  banks_free(&e->banks);
+  subcircuits_free(&e->subcircuits);
+  arena_free(&e->arena);
+  arena_free(&e->state_arena);
+}
+
+// everything derived from the nodes, for the grid of the current state. the
+// arena in use is only replaced once the new one is reserved
+Result signal_engine_alloc(Engine* e) {
+  Engine probe = *e;
+  Arena measure = {0};
+  signal_engine_carve(&probe, &measure);
+  Arena arena = {0};
+  if (arena_init(&arena, measure.used, e->huge_pages) != Ok) {
+    return Err;
+  }
+  arena_free(&e->arena);
+  e->arena = arena;
+  signal_engine_carve(e, &e->arena);
+  for (u32 i = 0; i < e->state.nodes.max_node; ++i) {
+    e->node_colors[i] = colors[COLOR_BLACK];
+  }
+  return Ok;
+}
+
+void signal_engine_carve(Engine* e, Arena* arena) {
+  e->node_colors = arena_alloc(arena, sizeof(u32) * e->state.nodes.max_node);
+  node_index_alloc(e, arena);
+  netlist_alloc(e, arena);
+  sync_alloc(e, arena);
+  bitslice_alloc(e, arena);
+  analysis_alloc(e, arena);
+  clocks_alloc(e, arena);
+  channels_alloc(e, arena);
+  banks_alloc(e, arena);
+  subcircuits_alloc(e, arena);
+}
+
 void signal_engine_init(Engine* e) {
   signal_state_init(&e->state);
   e->show_info_box = true;
   e->show_log_box = false;
+  e->event_count = 0;
+  e->sim_engine = SIM_ENGINE_EVENT;
+  e->beat_cap = BEAT_CAP;
+  e->max_speed = false;
+  e->beat_budget = BEAT_BUDGET;
+  e->frame_beats = 0;
+  e->hashlife = false;
+  e->prune = false;
+  e->native.handle = NULL;
+  e->native.beat = NULL;
+  e->native.built = false;
+  e->native.pid = 0;
+  e->native.dir[0] = 0;
+  for (u32 i = 0; i < e->state.nodes.max_node; ++i) {
+    e->node_colors[i] = colors[COLOR_BLACK];
+  }
+  node_index_rebuild(e);
+}
+
+void signal_engine_run_headless(Engine* e, u32 beats, u32 fast_forward) {
+  State* state = &e->state;
+  e->event_count = 0;
+
+  // compile the circuit up front so only the simulation is timed
+  netlist_update(e);
+  if (e->sim_engine == SIM_ENGINE_NATIVE && codegen_build(e) != Ok) {
+    log_error("native kernel unavailable, using vm\n");
+  }
+
+  TIMER_START();
+  u32 simulated = beats;
+  if (state->mode == SIM_MODE_SYNC && e->hashlife && hashlife_advance(e, beats) == Ok) {
+    state->tick += beats;
+  }
+  else if (fast_forward) {
+    simulated = cycle_run(e, beats);
+  }
+  else {
+    for (u32 i = 0; i < beats; ++i) {
+      nodes_simulate_beat(e);
+      state->tick++;
+    }
+  }
+  f32 wall_time = TIMER_END();
+
+  f32 beats_per_sec = 0.0f;
+  f32 events_per_sec = 0.0f;
+  if (wall_time > 0.0f) {
+    beats_per_sec = simulated / wall_time;
+    events_per_sec = e->event_count / wall_time;
+  }
+  log_info("simulated %u beats (%lu node events) in %g s\n", simulated, (unsigned long)e->event_count, wall_time);
+  if (simulated != beats) {
+    log_info("fast-forwarded to beat %u\n", beats);
+  }
+  log_info("%g beats/sec, %g node events/sec\n", beats_per_sec, events_per_sec);
+}
+
+// run copies of the circuit side by side, lane i starting with the value of
+// the sweep node plus i
+Result signal_engine_run_batch(Engine* e, u32 beats, u32 lanes, i32 sweep) {
+  Nodes* nodes = &e->state.nodes;
+  Batch batch;
+  if (batch_create(&batch, e, lanes) != Ok) {
+    return Err;
+  }
+  if (sweep >= 0) {
+    for (u32 lane = 0; lane < lanes; ++lane) {
+      batch_set_value(&batch, lane, sweep, nodes->data[sweep].value + lane);
+    }
+  }
+
+  TIMER_START();
+  for (u32 i = 0; i < beats; ++i) {
+    batch_simulate_beat(&batch);
+    for (u32 lane = 0; lane < lanes; ++lane) {
+      u32 count = 0;
+      Batch_print* prints = batch_prints(&batch, lane, &count);
+      for (u32 n = 0; n < count; ++n) {
+        log_info("%u: %s: " NODE_VALUE_FMT "\n", lane, node_type_str[nodes->type[prints[n].input]], prints[n].value);
+      }
+    }
+  }
+  f32 wall_time = TIMER_END();
+
+  f32 beats_per_sec = 0.0f;
+  f32 events_per_sec = 0.0f;
+  if (wall_time > 0.0f) {
+    beats_per_sec = (f32)beats * lanes / wall_time;
+    events_per_sec = batch.event_count / wall_time;
+  }
+  log_info("simulated %u beats on %u lanes (%lu node events) in %g s\n", beats, lanes, (unsigned long)batch.event_count, wall_time);
+  log_info("%g lane beats/sec, %g node events/sec\n", beats_per_sec, events_per_sec);
+  batch_destroy(&batch);
+  return Ok;
 }
 
 i32 signal_engine_start(i32 argc, char** argv) {
   i32 result = EXIT_SUCCESS;
+  // every way out once the engine exists goes through the teardown at defer
+  Engine engine = {0};
+  u32 created = false;
 
   struct {
     char* state_path;
+    i32 headless;
+    i32 beats;
+    char* engine;
+    i32 threads;
+    char* mode;
+    i32 lanes;
+    i32 sweep;
+    i32 beat_cap;
+    i32 max_speed;
+    f32 budget;
+    i32 fast_forward;
+    i32 hashlife;
+    i32 prune;
+    i32 width;
+    i32 height;
+    i32 huge_pages;
+    i32 bank;
+    char* bank_file;
+    char* subcircuit;
   } options = {
     .state_path = "save.state",
+    .headless = false,
+    .beats = 1000,
+    .engine = "event",
+    .threads = 0,
+    .mode = NULL,
+    .lanes = 0,
+    .sweep = -1,
+    .beat_cap = BEAT_CAP,
+    .max_speed = false,
+    .budget = BEAT_BUDGET * 1000.0f,
+    .fast_forward = false,
+    .hashlife = false,
+    .prune = false,
+    .width = NODE_GRID_WIDTH,
+    .height = NODE_GRID_HEIGHT,
+    .huge_pages = false,
+    .bank = -1,
+    .bank_file = NULL,
+    .subcircuit = NULL,
   };
   arg_parser_init(true, 4, 4);
 
   Parse_arg args[] = {
     {0, NULL, "path to state file to save/load to", ArgString, 0, &options.state_path},
+    {0, "headless", "run the simulation without a window and report throughput", ArgInt, 0, &options.headless},
+    {'b', "beats", "number of beats to simulate in headless mode", ArgInt, 1, &options.beats},
+    {'e', "engine", "simulation engine (event, vm, native, tiles)", ArgString, 1, &options.engine},
+    {'t', "threads", "number of threads for the tiles engine, 0 for one per core", ArgInt, 1, &options.threads},
+    {'m', "mode", "simulation mode (cascade, sync, change), overrides the mode of the state file", ArgString, 1, &options.mode},
+    {'k', "lanes", "run this many copies of the circuit in lockstep by the sync rules in headless mode", ArgInt, 1, &options.lanes},
+    {0, "sweep", "node id whose value is offset by the lane number in every copy", ArgInt, 1, &options.sweep},
+    {'c', "cap", "most beats to run in one frame, 0 for no limit", ArgInt, 1, &options.beat_cap},
+    {0, "max-speed", "run beats as fast as the frame budget allows instead of by bpm", ArgInt, 0, &options.max_speed},
+    {0, "budget", "milliseconds of every frame spent on beats at max speed", ArgFloat, 1, &options.budget},
+    {'f', "fast-forward", "skip whole periods once the state repeats in headless mode", ArgInt, 0, &options.fast_forward},
+    {0, "hashlife", "run sync mode beats on a memoized quadtree", ArgInt, 0, &options.hashlife},
+    {0, "prune", "skip the nodes that can't reach a PRINT, they keep their values", ArgInt, 0, &options.prune},
+    {0, "width", "grid width when starting without a state file, a loaded state keeps its own", ArgInt, 1, &options.width},
+    {0, "height", "grid height when starting without a state file, a loaded state keeps its own", ArgInt, 1, &options.height},
+    {0, "huge-pages", "back the node arrays with huge pages where the system has them", ArgInt, 0, &options.huge_pages},
+    {0, "bank", "MEMORY node whose words are loaded from the bank file", ArgInt, 1, &options.bank},
+    {0, "bank-file", "file of raw words loaded into the bank node after the state file", ArgString, 1, &options.bank_file},
+    {0, "subcircuit", "subcircuit file loaded after the state file when given, captures are saved to it numbered", ArgString, 1, &options.subcircuit},
   };
 
   if (parse_args(args, LENGTH(args), (u32)argc, argv) != ArgParseOk) {
     return_defer(EXIT_FAILURE);
   }
 
-  Engine engine;
-  signal_engine_init(&engine);
+  if (options.width <= 0 || options.height <= 0 || (u64)options.width * (u64)options.height > MAX_GRID_NODES) {
+    log_error("grid dimensions must be positive and hold at most %u nodes\n", MAX_GRID_NODES);
+    return_defer(EXIT_FAILURE);
+  }
+  if (signal_engine_create(&engine, (u32)options.width, (u32)options.height, options.huge_pages) != Ok) {
+    return_defer(EXIT_FAILURE);
+  }
+  created = true;
   State* state = &engine.state;
 
-  signal_state_init(state);
+  engine.sim_engine = MAX_SIM_ENGINE;
+  for (u32 i = 0; i < MAX_SIM_ENGINE; ++i) {
+    if (!strcmp(options.engine, sim_engine_str[i])) {
+      engine.sim_engine = i;
+    }
+  }
+  if (engine.sim_engine == MAX_SIM_ENGINE) {
+    log_error("unknown simulation engine `%s`\n", options.engine);
+    return_defer(EXIT_FAILURE);
+  }
+
+  if (options.threads < 0) {
+    log_error("number of threads must be positive\n");
+    return_defer(EXIT_FAILURE);
+  }
+  tiles_set_threads((u32)options.threads);
+
+  if (options.beat_cap < 0) {
+    log_error("beat cap must be positive\n");
+    return_defer(EXIT_FAILURE);
+  }
+  if (options.budget <= 0.0f) {
+    log_error("beat budget must be positive\n");
+    return_defer(EXIT_FAILURE);
+  }
+  engine.beat_cap = (u32)options.beat_cap;
+  engine.max_speed = options.max_speed;
+  engine.beat_budget = options.budget / 1000.0f;
+  engine.hashlife = options.hashlife;
+  engine.prune = options.prune;
+  engine.subcircuits.path = options.subcircuit ? options.subcircuit : "save.sub";
+
+  u32 mode = MAX_SIM_MODE;
+  if (options.mode) {
+    for (u32 i = 0; i < MAX_SIM_MODE; ++i) {
+      if (!strcmp(options.mode, sim_mode_str[i])) {
+        mode = i;
+      }
+    }
+    if (mode == MAX_SIM_MODE) {
+      log_error("unknown simulation mode `%s`\n", options.mode);
+      return_defer(EXIT_FAILURE);
+    }
+  }
+
+  if (options.bank_file && options.bank < 0) {
+    log_error("a bank file needs the MEMORY node to load it into, given by --bank\n");
+    return_defer(EXIT_FAILURE);
+  }
+
+  if (options.headless) {
+    if (options.beats < 0) {
+      log_error("number of beats must be positive\n");
+      return_defer(EXIT_FAILURE);
+    }
+    if (signal_engine_state_load(options.state_path, &engine) != Ok) {
+      return_defer(EXIT_FAILURE);
+    }
+    if (options.bank_file && banks_load(&engine, (u32)options.bank, options.bank_file) != Ok) {
+      return_defer(EXIT_FAILURE);
+    }
+    if (options.subcircuit && subcircuits_load(&engine, options.subcircuit) != Ok) {
+      return_defer(EXIT_FAILURE);
+    }
+    if (mode != MAX_SIM_MODE) {
+      state->mode = mode;
+    }
+    if (options.lanes != 0) {
+      if (options.sweep >= (i32)state->nodes.max_node) {
+        log_error("sweep node must be below %u\n", state->nodes.max_node);
+        return_defer(EXIT_FAILURE);
+      }
+      if (signal_engine_run_batch(&engine, (u32)options.beats, (u32)options.lanes, options.sweep) != Ok) {
+        return_defer(EXIT_FAILURE);
+      }
+      return_defer(EXIT_SUCCESS);
+    }
+    signal_engine_run_headless(&engine, (u32)options.beats, options.fast_forward);
+    return_defer(EXIT_SUCCESS);
+  }
   signal_engine_state_load(options.state_path, &engine);
+  if (options.bank_file) {
+    banks_load(&engine, (u32)options.bank, options.bank_file);
+  }
+  if (options.subcircuit) {
+    subcircuits_load(&engine, options.subcircuit);
+  }
+  if (mode != MAX_SIM_MODE) {
+    state->mode = mode;
+  }
 
   const f32 DT_MAX = 0.5f;
   char title[MAX_TITLE_LENGTH] = {0};
@@ -82,6 +469,7 @@ i32 signal_engine_start(i32 argc, char** argv) {
       if (key_mod_ctrl) {
         if (key_pressed[KEY_Q]) {
           signal_state_init(state);
+          node_index_rebuild(&engine);
         }
         if (key_pressed[KEY_S]) {
           signal_engine_state_store(options.state_path, &engine);
@@ -89,6 +477,12 @@ i32 signal_engine_start(i32 argc, char** argv) {
         if (key_pressed[KEY_R]) {
           signal_engine_state_load(options.state_path, &engine);
         }
+        if (key_pressed[KEY_1]) {
+          state->bpm /= 10;
+        }
+        if (key_pressed[KEY_2]) {
+          state->bpm *= 10;
+        }
       }
       else {
         if (key_pressed[KEY_SPACE]) {
@@ -119,6 +513,26 @@ i32 signal_engine_start(i32 argc, char** argv) {
         if (key_pressed[KEY_L]) {
           engine.show_log_box = !engine.show_log_box;
         }
+        if (key_pressed[KEY_E]) {
+          engine.sim_engine = (engine.sim_engine + 1) % MAX_SIM_ENGINE;
+          signal_engine_log(&engine, "info", "simulation engine: %s", sim_engine_str[engine.sim_engine]);
+        }
+        if (key_pressed[KEY_F]) {
+          engine.max_speed = !engine.max_speed;
+          signal_engine_log(&engine, "info", "max speed: %s", true_str[engine.max_speed]);
+        }
+        if (key_pressed[KEY_H]) {
+          engine.hashlife = !engine.hashlife;
+          signal_engine_log(&engine, "info", "hashlife: %s", true_str[engine.hashlife]);
+        }
+        if (key_pressed[KEY_P]) {
+          engine.prune = !engine.prune;
+          signal_engine_log(&engine, "info", "prune dead nodes: %s", true_str[engine.prune]);
+        }
+        if (key_pressed[KEY_T]) {
+          state->mode = (state->mode + 1) % MAX_SIM_MODE;
+          signal_engine_log(&engine, "info", "simulation mode: %s", sim_mode_str[state->mode]);
+        }
       }
 
       if (mouse_pressed[MOUSE_BUTTON_MIDDLE]) {
@@ -137,7 +551,11 @@ i32 signal_engine_start(i32 argc, char** argv) {
       renderer_begin_frame(color_rgb(0x24, 0x29, 0x39));
 
       if (!(state->tick % 16)) {
-        snprintf(title, MAX_TITLE_LENGTH, "%s | %.4g bpm | %d fps | %.3g delta", PROG_NAME, state->bpm, (u32)(1.0f / state->dt), state->dt);
+        format_buffer(speed, 32, "%.4g bpm", state->bpm);
+        if (engine.max_speed) {
+          snprintf(speed, sizeof(speed), "max speed");
+        }
+        snprintf(title, MAX_TITLE_LENGTH, "%s | %s | %s | %u beats/frame | %d fps | %.3g delta", PROG_NAME, state->mode != SIM_MODE_CASCADE ? sim_mode_str[state->mode] : sim_engine_str[engine.sim_engine], speed, engine.frame_beats, (u32)(1.0f / state->dt), state->dt);
         platform_set_title(title);
       }
       nodes_update_and_render(&engine);
@@ -148,6 +566,12 @@ i32 signal_engine_start(i32 argc, char** argv) {
     platform_destroy();
   }
 defer:
+  if (created) {
+    codegen_unload(&engine);
+    tiles_destroy();
+    hashlife_destroy();
+    signal_engine_destroy(&engine);
+  }
   return result;
 }
 
@@ -176,24 +600,241 @@ void signal_engine_log(Engine* e, const char* tag, const char* format, ...) {
   va_end(argp);
 }
 
+Result state_field(Buffer* buffer, void* data, u32 size, u32* iter, u32 write) {
+  if (write) {
+    buffer_append(buffer, data, size);
+    return Ok;
+  }
+  if (*iter + size > buffer->size) {
+    return Err;
+  }
+  buffer_iterate(data, buffer, size, iter);
+  return Ok;
+}
+
+// the serialized fields of a state in file order, fields added in later versions
+// are skipped when reading older files and keep their initialized value
+Result state_serialize(Buffer* buffer, State* state, u32 version, u32* iter, u32 write) {
+  Result result = Ok;
+  Nodes* nodes = &state->nodes;
+#define FIELD(MIN_VERSION, FIELD) \
+  if (version >= MIN_VERSION && state_field(buffer, &(FIELD), sizeof(FIELD), iter, write) != Ok) { \
+    return_defer(Err); \
+  }
+  // one element per node
+#define FIELD_ARRAY(MIN_VERSION, FIELD) \
+  if (version >= MIN_VERSION && state_field(buffer, (FIELD), nodes->max_node * sizeof(*(FIELD)), iter, write) != Ok) { \
+    return_defer(Err); \
+  }
+  FIELD(1, state->dt);
+  FIELD(1, state->timer);
+  FIELD(1, state->bpm);
+  FIELD(1, state->tick);
+  FIELD(1, state->paused);
+  FIELD(1, state->camera);
+  FIELD_ARRAY(1, nodes->type);
+  // the value width of the build that wrote the file, files written before it
+  // was stored are 16 bits
+  u32 value_bits = NODE_VALUE_BITS;
+  if (!write && version < 3) {
+    value_bits = 16;
+  }
+  FIELD(3, value_bits);
+  if (value_bits == NODE_VALUE_BITS) {
+    FIELD_ARRAY(1, nodes->data);
+  }
+  else if (state_values(buffer, nodes, value_bits, iter) != Ok) {
+    return_defer(Err);
+  }
+  FIELD_ARRAY(1, nodes->alive);
+  FIELD_ARRAY(1, nodes->reads);
+  FIELD_ARRAY(1, nodes->writes);
+  FIELD_ARRAY(1, nodes->ready);
+  FIELD(2, state->mode);
+  FIELD_ARRAY(4, nodes->x);
+  FIELD_ARRAY(4, nodes->y);
+  FIELD_ARRAY(5, nodes->delay);
+  FIELD_ARRAY(6, nodes->period);
+  FIELD_ARRAY(6, nodes->phase);
+  FIELD_ARRAY(7, nodes->channel);
+  FIELD_ARRAY(9, nodes->body);
+#undef FIELD
+#undef FIELD_ARRAY
+defer:
+  return result;
+}
+
+// values of another width are widened, or cut to the low bits of this build
+Result state_values(Buffer* buffer, Nodes* nodes, u32 bits, u32* iter) {
+  Result result = Ok;
+  u32 truncated = 0;
+  if (bits != 8 && bits != 16 && bits != 32 && bits != 64) {
+    log_error("state_values: unsupported value width %u\n", bits);
+    return_defer(Err);
+  }
+  if ((u64)*iter + (u64)nodes->max_node * (bits / 8) > buffer->size) {
+    return_defer(Err);
+  }
+  for (u32 i = 0; i < nodes->max_node; ++i) {
+    u64 value = 0;
+    switch (bits) {
+      case 8: {
+        u8 v = 0;
+        buffer_iterate(&v, buffer, sizeof(v), iter);
+        value = v;
+        break;
+      }
+      case 16: {
+        u16 v = 0;
+        buffer_iterate(&v, buffer, sizeof(v), iter);
+        value = v;
+        break;
+      }
+      case 32: {
+        u32 v = 0;
+        buffer_iterate(&v, buffer, sizeof(v), iter);
+        value = v;
+        break;
+      }
+      default: {
+        buffer_iterate(&value, buffer, sizeof(value), iter);
+        break;
+      }
+    }
+    nodes->data[i].value = (Node_value)value;
+    truncated += nodes->data[i].value != value;
+  }
+  if (truncated) {
+    log_info("state was saved with %u bit values, %u of them did not fit in %u bits (build with VALUE_BITS=%u to keep them)\n", bits, truncated, NODE_VALUE_BITS, bits);
+  }
+defer:
+  return result;
+}
+
+void state_from_v0(State* state, State_v0* v0) {
+  state->dt = v0->dt;
+  state->timer = v0->timer;
+  state->bpm = v0->bpm;
+  state->tick = v0->tick;
+  state->paused = v0->paused;
+  state->camera = v0->camera;
+  state->mode = SIM_MODE_CASCADE;
+  Nodes* nodes = &state->nodes;
+  for (u32 i = 0; i < LENGTH(v0->nodes); ++i) {
+    Node_v0* node = &v0->nodes[i];
+    nodes->type[i] = node->type < MAX_NODE_TYPE ? node->type : NODE_NONE;
+    nodes->data[i].value = node->value;
+    nodes->alive[i] = node->alive;
+    nodes->reads[i] = node->reads;
+    nodes->writes[i] = node->writes;
+    nodes->ready[i] = node->ready;
+    nodes->x[i] = i % V0_GRID_WIDTH;
+    nodes->y[i] = i / V0_GRID_WIDTH;
+  }
+}
+
 void signal_engine_state_store(const char* path, Engine* e) {
+  State_header header = {
+    .magic = STATE_MAGIC,
+    .version = STATE_VERSION,
+    .grid_width = e->state.nodes.grid_width,
+    .grid_height = e->state.nodes.grid_height,
+  };
   Buffer buffer;
-  buffer.data = (u8*)&e->state;
-  buffer.size = sizeof(State);
+  buffer_init(&buffer);
+  buffer_append(&buffer, &header, sizeof(header));
+  u32 iter = 0;
+  state_serialize(&buffer, &e->state, STATE_VERSION, &iter, true);
+  banks_write(&e->banks, &buffer);
+  subcircuits_write(&e->subcircuits, &buffer);
   if (file_write(path, &buffer) == Ok) {
     signal_engine_log(e, "info", "stored state file %s", path);
   }
+  buffer_free(&buffer);
 }
 
-void signal_engine_state_load(const char* path, Engine* e) {
+// the file is read into a state of its own dimensions, which replaces the
+// current one only once it parsed
+Result signal_engine_state_load(const char* path, Engine* e) {
+  Result result = Ok;
   Buffer buffer;
-  if (file_read(path, &buffer) == Ok) {
-    if (sizeof(State) != buffer.size) {
+  State state = e->state;
+  Arena arena = {0};
+  Banks banks = {0};
+  Subcircuits subcircuits = {0};
+  if (file_read(path, &buffer) != Ok) {
+    return_defer(Err);
+  }
+  if (buffer.size == sizeof(State_v0)) {
+    if (signal_state_alloc(&state, &arena, V0_GRID_WIDTH, V0_GRID_HEIGHT, e->huge_pages) != Ok) {
+      buffer_free(&buffer);
+      return_defer(Err);
+    }
+    // the fields a v0 file doesn't have start as on a new grid
+    node_grid_init(&state);
+    state_from_v0(&state, (State_v0*)buffer.data);
+  }
+  else {
+    State_header header = {0};
+    u32 iter = 0;
+    if (state_field(&buffer, &header, sizeof(header), &iter, false) != Ok || header.magic != STATE_MAGIC) {
       log_error("signals_state_load: tried loading a corrupt/incorrect version of state file `%s`\n", path);
-      return;
+      buffer_free(&buffer);
+      return_defer(Err);
+    }
+    if (header.version > STATE_VERSION || header.grid_width == 0 || header.grid_height == 0 || (u64)header.grid_width * header.grid_height > MAX_GRID_NODES) {
+      log_error("signals_state_load: state file `%s` (version %u, %ux%u grid) is not supported by this build\n", path, header.version, header.grid_width, header.grid_height);
+      buffer_free(&buffer);
+      return_defer(Err);
+    }
+    if (signal_state_alloc(&state, &arena, header.grid_width, header.grid_height, e->huge_pages) != Ok) {
+      buffer_free(&buffer);
+      return_defer(Err);
+    }
+    state.mode = SIM_MODE_CASCADE;
+    // older files place every node in the cell of its id
+    node_grid_init(&state);
+    // the banks of the MEMORY nodes follow the fields, then the subcircuits
+    if (state_serialize(&buffer, &state, header.version, &iter, false) != Ok || (header.version >= 8 && banks_read(&banks, &buffer, &iter) != Ok) || (header.version >= 9 && subcircuits_read(&subcircuits, &buffer, &iter) != Ok)) {
+      log_error("signals_state_load: state file `%s` is truncated\n", path);
+      buffer_free(&buffer);
+      banks_free(&banks);
+      subcircuits_free(&subcircuits);
+      arena_free(&arena);
+      return_defer(Err);
     }
-    memcpy(&e->state, buffer.data, buffer.size);
-    buffer_free(&buffer);
-    signal_engine_log(e, "info", "loaded state file %s", path);
+    if (state.mode >= MAX_SIM_MODE) {
+      state.mode = SIM_MODE_CASCADE;
+    }
+    // a type this build doesn't know leaves an empty cell, as for v0 files
+    for (u32 i = 0; i < state.nodes.max_node; ++i) {
+      if (state.nodes.type[i] >= MAX_NODE_TYPE) {
+        state.nodes.type[i] = NODE_NONE;
+      }
+    }
+  }
+  buffer_free(&buffer);
+  // a CLOCK fires at least every beat
+  for (u32 i = 0; i < state.nodes.max_node; ++i) {
+    state.nodes.period[i] = MAX(state.nodes.period[i], 1);
   }
+  State current = e->state;
+  e->state = state;
+  if (state.nodes.max_node != current.nodes.max_node || state.nodes.grid_width != current.nodes.grid_width) {
+    if (signal_engine_alloc(e) != Ok) {
+      e->state = current;
+      arena_free(&arena);
+      banks_free(&banks);
+      subcircuits_free(&subcircuits);
+      return_defer(Err);
+    }
+  }
+  arena_free(&e->state_arena);
+  e->state_arena = arena;
+  banks_replace(e, &banks);
+  subcircuits_replace(e, &subcircuits);
+  node_index_rebuild(e);
+  signal_engine_log(e, "info", "loaded state file %s", path);
+defer:
+  return result;
 }
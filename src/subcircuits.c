@@ -0,0 +1,881 @@
+// subcircuits.c
+
+#define SUBCIRCUITS_MIN 4
+
+typedef struct {
+  u32 magic;
+  u32 version;
+  u32 bits;
+} Subcircuit_header;
+
+// the values and flags of one instance while a signal runs through its body
+typedef struct {
+  Engine* e;
+  Body* body;
+  Node_value* value;
+  u8* reads;
+  u8* writes;
+  u32 frame_count;
+  u8 type; // of the node outside that sent into the body
+  u32 sides;
+  Node_value* out;
+  u64 event_count;
+} Body_run;
+
+static u32 subcircuits_add(Engine* e, u32 id);
+static void subcircuits_remove(Engine* e, u32 i);
+static Result subcircuits_grow(Subcircuits* subcircuits, u32 count, u32 values);
+static u32 subcircuits_allowed(u8 type);
+static Result subcircuits_compile(Body* body);
+static void subcircuits_dispatch(Body_run* run, u32 pc, u32 input, Node_value input_value);
+static void subcircuits_drain(Body_run* run);
+static u32 subcircuits_equal(Body* a, Body* b);
+static Result subcircuits_append(Subcircuits* subcircuits, Body* body);
+static void subcircuits_write_body(Body* body, Buffer* buffer);
+static Result subcircuits_read_body(Body* body, u32 bits, Buffer* buffer, u32* iter);
+static Result subcircuits_read_values(Node_value* values, u32 count, u32 bits, Buffer* buffer, u32* iter);
+static void subcircuits_free_body(Body* body);
+static Result subcircuits_field(Buffer* buffer, void* data, u32 size, u32* iter);
+static Result subcircuits_body_path(char* out, const char* path, u32 b);
+
+void subcircuits_alloc(Engine* e, Arena* arena) {
+  Subcircuits* subcircuits = &e->subcircuits;
+  u32 max_node = e->state.nodes.max_node;
+  subcircuits->instance = arena_alloc(arena, sizeof(u32) * max_node);
+  if (subcircuits->instance) {
+    memset(subcircuits->instance, 0xff, sizeof(u32) * max_node);
+  }
+}
+
+void subcircuits_update(Engine* e, u32 id) {
+  Nodes* nodes = &e->state.nodes;
+  Subcircuits* subcircuits = &e->subcircuits;
+  u32 macro = nodes->alive[id] && nodes->type[id] == NODE_MACRO && nodes->body[id] < subcircuits->body_count;
+  u32 i = subcircuits->instance[id];
+  if (i != NO_NODE && (!macro || subcircuits->instances[i].body != nodes->body[id])) {
+    subcircuits_remove(e, i);
+    i = NO_NODE;
+  }
+  if (macro && i == NO_NODE) {
+    subcircuits_add(e, id);
+  }
+}
+
+// the instances of nodes that are gone or run another body are dropped, and
+// the MACRO nodes left without one get one
+void subcircuits_rebuild(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Node_index* index = &e->index;
+  Subcircuits* subcircuits = &e->subcircuits;
+  subcircuits_ready(e);
+  memset(subcircuits->instance, 0xff, sizeof(u32) * nodes->max_node);
+  u32 kept = 0;
+  u32 used = 0;
+  for (u32 i = 0; i < subcircuits->count; ++i) {
+    Instance* instance = &subcircuits->instances[i];
+    u32 id = instance->node;
+    if (id >= nodes->max_node || !nodes->alive[id] || nodes->type[id] != NODE_MACRO || nodes->body[id] != instance->body || subcircuits->instance[id] != NO_NODE) {
+      continue;
+    }
+    // kept in order, so the values only ever move down
+    memmove(&subcircuits->values[used], &subcircuits->values[instance->first], sizeof(Node_value) * instance->count);
+    instance->first = used;
+    used += instance->count;
+    if (kept != i) {
+      subcircuits->instances[kept] = *instance;
+    }
+    subcircuits->instance[id] = kept++;
+  }
+  subcircuits->count = kept;
+  subcircuits->used = used;
+  for (u32 i = 0; i < index->alive_count; ++i) {
+    u32 id = index->alive[i];
+    if (nodes->type[id] == NODE_MACRO && nodes->body[id] < subcircuits->body_count && subcircuits->instance[id] == NO_NODE) {
+      subcircuits_add(e, id);
+    }
+  }
+}
+
+void subcircuits_ready(Engine* e) {
+  Subcircuits* subcircuits = &e->subcircuits;
+  for (u32 i = 0; i < subcircuits->touched_count; ++i) {
+    Instance* instance = &subcircuits->instances[subcircuits->touched[i]];
+    memset(&subcircuits->reads[instance->first], 0, instance->count);
+    memset(&subcircuits->writes[instance->first], 0, instance->count);
+    instance->touched = false;
+  }
+  subcircuits->touched_count = 0;
+}
+
+Instance* subcircuits_of(Engine* e, u32 id) {
+  u32 i = e->subcircuits.instance[id];
+  return i != NO_NODE ? &e->subcircuits.instances[i] : NULL;
+}
+
+u32 subcircuits_run(Engine* e, u32 id, u32 side, Node_value value, u32 copy, u8 type, Node_value* out) {
+  Subcircuits* subcircuits = &e->subcircuits;
+  u32 i = subcircuits->instance[id];
+  if (i == NO_NODE) {
+    return 0;
+  }
+  Instance* instance = &subcircuits->instances[i];
+  Body* body = &subcircuits->bodies[instance->body];
+  u32 port = body->port[side];
+  if (port == NO_NODE) {
+    return 0;
+  }
+  if (!instance->touched) {
+    instance->touched = true;
+    subcircuits->touched[subcircuits->touched_count++] = i;
+  }
+  Body_run run = {
+    .e = e,
+    .body = body,
+    .value = &subcircuits->values[instance->first],
+    .reads = &subcircuits->reads[instance->first],
+    .writes = &subcircuits->writes[instance->first],
+    .frame_count = 0,
+    .type = type,
+    .sides = 0,
+    .out = out,
+    .event_count = 0,
+  };
+  if (copy) {
+    run.value[port] = value;
+  }
+  subcircuits_dispatch(&run, port, body->count + side, value);
+  subcircuits_drain(&run);
+  e->event_count += run.event_count;
+  return run.sides;
+}
+
+u32 subcircuits_copies(Engine* e, u32 id, u32 side) {
+  switch (e->state.nodes.type[id]) {
+    case NODE_COPY:
+    case NODE_COPY_LR:
+    case NODE_COPY_RL:
+    case NODE_COPY_UD:
+    case NODE_COPY_DU:
+      return true;
+    case NODE_MACRO: {
+      Instance* instance = subcircuits_of(e, id);
+      return instance && (e->subcircuits.bodies[instance->body].copies & (1 << side));
+    }
+    default:
+      return false;
+  }
+}
+
+u32 subcircuits_prints(Engine* e, u32 id) {
+  Instance* instance = subcircuits_of(e, id);
+  return instance && e->subcircuits.bodies[instance->body].prints;
+}
+
+u32 subcircuits_changed(Engine* e, u32 id, u32 sides, Node_value* out) {
+  Instance* instance = subcircuits_of(e, id);
+  if (!instance) {
+    return 0;
+  }
+  for (u32 d = 0; d < MAX_DIR; ++d) {
+    if (!(sides & (1 << d))) {
+      continue;
+    }
+    if ((instance->has_emitted & (1 << d)) && instance->emitted[d] == out[d]) {
+      sides &= ~(1 << d);
+      continue;
+    }
+    instance->emitted[d] = out[d];
+    instance->has_emitted |= 1 << d;
+  }
+  return sides;
+}
+
+void subcircuits_forget(Engine* e, u32 id) {
+  Subcircuits* subcircuits = &e->subcircuits;
+  if (id != NO_NODE) {
+    Instance* instance = subcircuits_of(e, id);
+    if (instance) {
+      instance->has_emitted = 0;
+    }
+    return;
+  }
+  for (u32 i = 0; i < subcircuits->count; ++i) {
+    subcircuits->instances[i].has_emitted = 0;
+  }
+}
+
+Result subcircuits_capture(Engine* e, i32 x0, i32 y0, i32 x1, i32 y1) {
+  Result result = Ok;
+  Nodes* nodes = &e->state.nodes;
+  Subcircuits* subcircuits = &e->subcircuits;
+  Buffer buffer = {0};
+  Body body = {0};
+  i32 left = MIN(x0, x1);
+  i32 top = MIN(y0, y1);
+  body.width = (u32)(MAX(x0, x1) - left) + 1;
+  body.height = (u32)(MAX(y0, y1) - top) + 1;
+  if (body.width > MAX_SUBCIRCUIT_SIDE || body.height > MAX_SUBCIRCUIT_SIDE) {
+    signal_engine_log(e, "error", "a subcircuit is at most %ux%u", MAX_SUBCIRCUIT_SIDE, MAX_SUBCIRCUIT_SIDE);
+    return_defer(Err);
+  }
+  u32 cell_count = body.width * body.height;
+  body.cells = malloc(cell_count);
+  body.value = malloc(sizeof(Node_value) * cell_count);
+  if (!body.cells || !body.value) {
+    return_defer(Err);
+  }
+  u32 count = 0;
+  for (u32 c = 0; c < cell_count; ++c) {
+    u32 id = grid_get(&e->grid, left + (i32)(c % body.width), top + (i32)(c / body.width));
+    body.cells[c] = NO_CELL;
+    if (id == NO_NODE) {
+      continue;
+    }
+    if (!subcircuits_allowed(nodes->type[id])) {
+      signal_engine_log(e, "error", "a %s node can't be part of a subcircuit", node_type_str[nodes->type[id]]);
+      return_defer(Err);
+    }
+    body.cells[c] = nodes->type[id];
+    body.value[count++] = nodes->data[id].value;
+  }
+  if (count == 0) {
+    signal_engine_log(e, "error", "the region holds no nodes");
+    return_defer(Err);
+  }
+  if (subcircuits_compile(&body) != Ok || subcircuits_append(subcircuits, &body) != Ok) {
+    return_defer(Err);
+  }
+  u32 b = subcircuits->body_count - 1;
+  signal_engine_log(e, "info", "captured subcircuit %u, %ux%u with %u nodes", b, body.width, body.height, count);
+  body = (Body) {0};
+  char path[MAX_PATH_SIZE] = {0};
+  if (subcircuits->path && subcircuits_body_path(path, subcircuits->path, b) == Ok) {
+    Subcircuit_header header = {
+      .magic = SUBCIRCUIT_MAGIC,
+      .version = SUBCIRCUIT_VERSION,
+      .bits = NODE_VALUE_BITS,
+    };
+    buffer_append(&buffer, &header, sizeof(header));
+    subcircuits_write_body(&subcircuits->bodies[b], &buffer);
+    if (file_write(path, &buffer) == Ok) {
+      signal_engine_log(e, "info", "stored subcircuit file %s", path);
+    }
+  }
+defer:
+  subcircuits_free_body(&body);
+  buffer_free(&buffer);
+  return result;
+}
+
+Result subcircuits_load(Engine* e, const char* path) {
+  Result result = Ok;
+  Subcircuits* subcircuits = &e->subcircuits;
+  Buffer buffer = {0};
+  Body body = {0};
+  Subcircuit_header header = {0};
+  u32 iter = 0;
+  if (file_read(path, &buffer) != Ok) {
+    return_defer(Err);
+  }
+  if (subcircuits_field(&buffer, &header, sizeof(header), &iter) != Ok || header.magic != SUBCIRCUIT_MAGIC) {
+    log_error("subcircuits_load: `%s` is not a subcircuit file\n", path);
+    return_defer(Err);
+  }
+  if (header.version != SUBCIRCUIT_VERSION) {
+    log_error("subcircuits_load: `%s` has version %u, expected %u\n", path, header.version, SUBCIRCUIT_VERSION);
+    return_defer(Err);
+  }
+  if (subcircuits_read_body(&body, header.bits, &buffer, &iter) != Ok) {
+    log_error("subcircuits_load: `%s` is truncated or holds nodes a subcircuit can't\n", path);
+    return_defer(Err);
+  }
+  for (u32 b = 0; b < subcircuits->body_count; ++b) {
+    if (subcircuits_equal(&subcircuits->bodies[b], &body)) {
+      signal_engine_log(e, "info", "subcircuit %s is already loaded as %u", path, b);
+      return_defer(Ok);
+    }
+  }
+  if (subcircuits_append(subcircuits, &body) != Ok) {
+    return_defer(Err);
+  }
+  body = (Body) {0};
+  signal_engine_log(e, "info", "loaded subcircuit %s as %u", path, subcircuits->body_count - 1);
+defer:
+  subcircuits_free_body(&body);
+  buffer_free(&buffer);
+  return result;
+}
+
+void subcircuits_write(Subcircuits* subcircuits, Buffer* buffer) {
+  u32 bits = NODE_VALUE_BITS;
+  buffer_append(buffer, &bits, sizeof(bits));
+  buffer_append(buffer, &subcircuits->body_count, sizeof(subcircuits->body_count));
+  for (u32 b = 0; b < subcircuits->body_count; ++b) {
+    subcircuits_write_body(&subcircuits->bodies[b], buffer);
+  }
+  buffer_append(buffer, &subcircuits->count, sizeof(subcircuits->count));
+  for (u32 i = 0; i < subcircuits->count; ++i) {
+    Instance* instance = &subcircuits->instances[i];
+    buffer_append(buffer, &instance->node, sizeof(instance->node));
+    buffer_append(buffer, &instance->body, sizeof(instance->body));
+    buffer_append(buffer, &subcircuits->values[instance->first], sizeof(Node_value) * instance->count);
+  }
+}
+
+Result subcircuits_read(Subcircuits* subcircuits, Buffer* buffer, u32* iter) {
+  Result result = Ok;
+  u32 bits = 0;
+  u32 body_count = 0;
+  u32 count = 0;
+  *subcircuits = (Subcircuits) {0};
+  if (subcircuits_field(buffer, &bits, sizeof(bits), iter) != Ok || subcircuits_field(buffer, &body_count, sizeof(body_count), iter) != Ok) {
+    return_defer(Err);
+  }
+  if (bits != 8 && bits != 16 && bits != 32 && bits != 64) {
+    log_error("subcircuits_read: unsupported value width %u\n", bits);
+    return_defer(Err);
+  }
+  for (u32 b = 0; b < body_count; ++b) {
+    Body body = {0};
+    if (subcircuits_read_body(&body, bits, buffer, iter) != Ok || subcircuits_append(subcircuits, &body) != Ok) {
+      subcircuits_free_body(&body);
+      return_defer(Err);
+    }
+  }
+  if (subcircuits_field(buffer, &count, sizeof(count), iter) != Ok) {
+    return_defer(Err);
+  }
+  for (u32 i = 0; i < count; ++i) {
+    u32 node = 0;
+    u32 b = 0;
+    if (subcircuits_field(buffer, &node, sizeof(node), iter) != Ok || subcircuits_field(buffer, &b, sizeof(b), iter) != Ok || b >= body_count) {
+      return_defer(Err);
+    }
+    u32 values = subcircuits->bodies[b].count;
+    if (subcircuits_grow(subcircuits, subcircuits->count + 1, subcircuits->used + values) != Ok) {
+      return_defer(Err);
+    }
+    Instance* instance = &subcircuits->instances[subcircuits->count];
+    memset(instance, 0, sizeof(*instance));
+    instance->node = node;
+    instance->body = b;
+    instance->first = subcircuits->used;
+    instance->count = values;
+    if (subcircuits_read_values(&subcircuits->values[instance->first], values, bits, buffer, iter) != Ok) {
+      return_defer(Err);
+    }
+    memset(&subcircuits->reads[instance->first], 0, values);
+    memset(&subcircuits->writes[instance->first], 0, values);
+    subcircuits->used += values;
+    subcircuits->count++;
+  }
+defer:
+  if (result != Ok) {
+    subcircuits_free(subcircuits);
+  }
+  return result;
+}
+
+void subcircuits_replace(Engine* e, Subcircuits* subcircuits) {
+  u32* instance = e->subcircuits.instance;
+  const char* path = e->subcircuits.path;
+  subcircuits_free(&e->subcircuits);
+  e->subcircuits = *subcircuits;
+  e->subcircuits.instance = instance;
+  e->subcircuits.path = path;
+  *subcircuits = (Subcircuits) {0};
+}
+
+void subcircuits_free(Subcircuits* subcircuits) {
+  for (u32 b = 0; b < subcircuits->body_count; ++b) {
+    subcircuits_free_body(&subcircuits->bodies[b]);
+  }
+  free(subcircuits->bodies);
+  free(subcircuits->instances);
+  free(subcircuits->values);
+  free(subcircuits->reads);
+  free(subcircuits->writes);
+  free(subcircuits->touched);
+  subcircuits->bodies = NULL;
+  subcircuits->body_count = 0;
+  subcircuits->instances = NULL;
+  subcircuits->count = 0;
+  subcircuits->max = 0;
+  subcircuits->values = NULL;
+  subcircuits->reads = NULL;
+  subcircuits->writes = NULL;
+  subcircuits->used = 0;
+  subcircuits->max_value = 0;
+  subcircuits->touched = NULL;
+  subcircuits->touched_count = 0;
+}
+
+// starts with the values the body was captured with
+u32 subcircuits_add(Engine* e, u32 id) {
+  Nodes* nodes = &e->state.nodes;
+  Subcircuits* subcircuits = &e->subcircuits;
+  Body* body = &subcircuits->bodies[nodes->body[id]];
+  if (subcircuits_grow(subcircuits, subcircuits->count + 1, subcircuits->used + body->count) != Ok) {
+    log_error("subcircuits: failed to allocate the values of node %u\n", id);
+    return NO_NODE;
+  }
+  u32 i = subcircuits->count++;
+  Instance* instance = &subcircuits->instances[i];
+  memset(instance, 0, sizeof(*instance));
+  instance->node = id;
+  instance->body = nodes->body[id];
+  instance->first = subcircuits->used;
+  instance->count = body->count;
+  memcpy(&subcircuits->values[instance->first], body->value, sizeof(Node_value) * body->count);
+  memset(&subcircuits->reads[instance->first], 0, body->count);
+  memset(&subcircuits->writes[instance->first], 0, body->count);
+  subcircuits->used += body->count;
+  subcircuits->instance[id] = i;
+  return i;
+}
+
+// the values after it move down over the hole, and the last instance moves
+// into its slot
+void subcircuits_remove(Engine* e, u32 i) {
+  Subcircuits* subcircuits = &e->subcircuits;
+  Instance* instance = &subcircuits->instances[i];
+  u32 first = instance->first;
+  u32 count = instance->count;
+  u32 tail = subcircuits->used - first - count;
+  memmove(&subcircuits->values[first], &subcircuits->values[first + count], sizeof(Node_value) * tail);
+  memmove(&subcircuits->reads[first], &subcircuits->reads[first + count], tail);
+  memmove(&subcircuits->writes[first], &subcircuits->writes[first + count], tail);
+  subcircuits->used -= count;
+  for (u32 k = 0; k < subcircuits->count; ++k) {
+    if (subcircuits->instances[k].first > first) {
+      subcircuits->instances[k].first -= count;
+    }
+  }
+  u32 last = --subcircuits->count;
+  for (u32 t = 0; t < subcircuits->touched_count; ++t) {
+    if (subcircuits->touched[t] == i) {
+      subcircuits->touched[t--] = subcircuits->touched[--subcircuits->touched_count];
+    }
+    else if (subcircuits->touched[t] == last) {
+      subcircuits->touched[t] = i;
+    }
+  }
+  subcircuits->instance[instance->node] = NO_NODE;
+  if (i != last) {
+    *instance = subcircuits->instances[last];
+    subcircuits->instance[instance->node] = i;
+  }
+}
+
+Result subcircuits_grow(Subcircuits* subcircuits, u32 count, u32 values) {
+  if (count > subcircuits->max) {
+    u32 max = MAX(MAX(2 * subcircuits->max, count), SUBCIRCUITS_MIN);
+    Instance* instances = realloc(subcircuits->instances, sizeof(Instance) * max);
+    if (!instances) {
+      return Err;
+    }
+    subcircuits->instances = instances;
+    u32* touched = realloc(subcircuits->touched, sizeof(u32) * max);
+    if (!touched) {
+      return Err;
+    }
+    subcircuits->touched = touched;
+    subcircuits->max = max;
+  }
+  if (values > subcircuits->max_value) {
+    u32 max = MAX(2 * subcircuits->max_value, values);
+    Node_value* pool = realloc(subcircuits->values, sizeof(Node_value) * max);
+    if (!pool) {
+      return Err;
+    }
+    subcircuits->values = pool;
+    u8* reads = realloc(subcircuits->reads, max);
+    if (!reads) {
+      return Err;
+    }
+    subcircuits->reads = reads;
+    u8* writes = realloc(subcircuits->writes, max);
+    if (!writes) {
+      return Err;
+    }
+    subcircuits->writes = writes;
+    subcircuits->max_value = max;
+  }
+  return Ok;
+}
+
+// a body runs to the end within the beat of the signal that started it, so it
+// can't hold a value for later, fire on its own or reach outside itself
+u32 subcircuits_allowed(u8 type) {
+  switch (type) {
+    case NODE_CLOCK:
+    case NODE_DELAY:
+    case NODE_SEND:
+    case NODE_RECEIVE:
+    case NODE_MEMORY:
+    case NODE_MACRO:
+      return false;
+    default:
+      return type < MAX_NODE_TYPE;
+  }
+}
+
+// resolve the neighbours of every node of the body to node indices, with the
+// edge past a port as the side of the MACRO
+Result subcircuits_compile(Body* body) {
+  u32 width = body->width;
+  u32 height = body->height;
+  u32 cell_count = width * height;
+  body->index = malloc(sizeof(u32) * cell_count);
+  if (!body->index) {
+    return Err;
+  }
+  u32 count = 0;
+  for (u32 c = 0; c < cell_count; ++c) {
+    body->index[c] = body->cells[c] != NO_CELL ? count++ : NO_NODE;
+  }
+  body->count = count;
+  body->program = malloc(sizeof(Instruction) * count);
+  // same bound as the frames of the event engine
+  body->frames = malloc(sizeof(Vm_frame) * count * MAX_WRITES);
+  if (!body->program || !body->frames) {
+    return Err;
+  }
+  const u32 port_cell[MAX_DIR] = {
+    [DIR_LEFT]  = (height / 2) * width,
+    [DIR_RIGHT] = (height / 2) * width + width - 1,
+    [DIR_UP]    = width / 2,
+    [DIR_DOWN]  = (height - 1) * width + width / 2,
+  };
+  body->copies = 0;
+  body->prints = false;
+  for (u32 d = 0; d < MAX_DIR; ++d) {
+    body->port[d] = body->index[port_cell[d]];
+    if (body->port[d] != NO_NODE) {
+      switch (body->cells[port_cell[d]]) {
+        case NODE_COPY:
+        case NODE_COPY_LR:
+        case NODE_COPY_RL:
+        case NODE_COPY_UD:
+        case NODE_COPY_DU:
+          body->copies |= 1 << d;
+          break;
+        default:
+          break;
+      }
+    }
+  }
+  const i32 offset[MAX_DIR][2] = {
+    [DIR_LEFT]  = { -1, 0, },
+    [DIR_RIGHT] = { 1, 0, },
+    [DIR_UP]    = { 0, -1, },
+    [DIR_DOWN]  = { 0, 1, },
+  };
+  for (u32 c = 0; c < cell_count; ++c) {
+    u32 pc = body->index[c];
+    if (pc == NO_NODE) {
+      continue;
+    }
+    i32 x = (i32)(c % width);
+    i32 y = (i32)(c / width);
+    u32 dir[MAX_DIR];
+    for (u32 d = 0; d < MAX_DIR; ++d) {
+      i32 nx = x + offset[d][0];
+      i32 ny = y + offset[d][1];
+      if (nx >= 0 && ny >= 0 && (u32)nx < width && (u32)ny < height) {
+        dir[d] = body->index[(u32)ny * width + (u32)nx];
+      }
+      else {
+        dir[d] = c == port_cell[d] ? count + d : NO_NODE;
+      }
+    }
+    Instruction* ins = &body->program[pc];
+    ins->op = body->cells[c];
+    ins->reads = node_events[ins->op].reads;
+    ins->node = pc;
+    ins->in = NO_NODE;
+    ins->out = NO_NODE;
+    switch (ins->op) {
+      case NODE_COPY_LR:
+        ins->in = dir[DIR_LEFT];
+        ins->out = dir[DIR_RIGHT];
+        break;
+      case NODE_COPY_RL:
+        ins->in = dir[DIR_RIGHT];
+        ins->out = dir[DIR_LEFT];
+        break;
+      case NODE_COPY_UD:
+        ins->in = dir[DIR_UP];
+        ins->out = dir[DIR_DOWN];
+        break;
+      case NODE_COPY_DU:
+        ins->in = dir[DIR_DOWN];
+        ins->out = dir[DIR_UP];
+        break;
+      case NODE_PRINT:
+        body->prints = true;
+        break;
+      default:
+        break;
+    }
+    ins->count = 0;
+    for (u32 d = 0; d < MAX_DIR; ++d) {
+      if (dir[d] != NO_NODE) {
+        ins->targets[ins->count++] = dir[d];
+      }
+    }
+  }
+  return Ok;
+}
+
+// same rules as netlist_dispatch, over the values of one instance. a NONE takes
+// one read per beat, the others until they are out of reads or writes
+void subcircuits_dispatch(Body_run* run, u32 pc, u32 input, Node_value input_value) {
+  Body* body = run->body;
+  Instruction* ins = &body->program[pc];
+  Engine* e = run->e;
+  u32 limit = ins->reads ? ins->reads : 1;
+  if (run->reads[pc] >= limit || run->writes[pc] >= MAX_WRITES) {
+    return;
+  }
+  run->event_count++;
+  // a directional copy only reads from the side it copies from
+  u32 directional = ins->op == NODE_COPY_LR || ins->op == NODE_COPY_RL || ins->op == NODE_COPY_UD || ins->op == NODE_COPY_DU;
+  if (directional && input != ins->in) {
+    return;
+  }
+
+  Node_value* value = &run->value[pc];
+  u8 reads = ++run->reads[pc];
+  u32 broadcast = false;
+  u32 forward = false;
+
+  switch (ins->op) {
+    case NODE_NONE:
+      break;
+    case NODE_ADD:
+      *value += input_value;
+      broadcast = reads == 2;
+      break;
+    case NODE_BUS:
+      broadcast = true;
+      break;
+    case NODE_AND:
+      if (reads == 1) {
+        *value = input_value;
+      }
+      else {
+        *value = *value && input_value;
+        broadcast = *value != 0;
+      }
+      break;
+    case NODE_PRINT: {
+      u8 type = input >= body->count ? run->type : body->program[input].op;
+      *value = input_value;
+      signal_engine_log(e, "node", "%s: " NODE_VALUE_FMT, node_type_str[type], *value);
+      log_info("%s: " NODE_VALUE_FMT "\n", node_type_str[type], *value);
+      break;
+    }
+    case NODE_INCR:
+      *value += input_value;
+      broadcast = true;
+      break;
+    case NODE_NOT:
+      *value = !input_value;
+      broadcast = true;
+      break;
+    case NODE_COPY:
+      *value = input_value;
+      broadcast = true;
+      break;
+    case NODE_EQUALS:
+      if (reads == 1) {
+        *value = input_value;
+      }
+      else {
+        *value = *value == input_value;
+        broadcast = *value != 0;
+      }
+      break;
+    case NODE_COPY_LR:
+    case NODE_COPY_RL:
+    case NODE_COPY_UD:
+    case NODE_COPY_DU:
+      *value = input_value;
+      forward = ins->out != NO_NODE;
+      break;
+    default:
+      assert(0);
+      break;
+  }
+
+  u32 count = 0;
+  if (broadcast) {
+    for (u32 i = 0; i < ins->count; ++i) {
+      count += ins->targets[i] != input;
+    }
+  }
+  if (count == 0 && !forward) {
+    return;
+  }
+  assert(run->frame_count < body->count * MAX_WRITES);
+  Vm_frame* frame = &body->frames[run->frame_count++];
+  frame->pc = pc;
+  frame->input = input;
+  frame->channel = NO_NODE;
+  frame->index = 0;
+  frame->forward = forward;
+  frame->sides = 0;
+}
+
+// same depth-first drain as netlist_run. what a node sends past the edge is
+// kept as the value of that side of the MACRO
+void subcircuits_drain(Body_run* run) {
+  Body* body = run->body;
+  while (run->frame_count > 0) {
+    Vm_frame* frame = &body->frames[run->frame_count - 1];
+    Instruction* ins = &body->program[frame->pc];
+    u32 target = NO_NODE;
+    if (frame->forward) {
+      if (frame->index == 0) {
+        target = ins->out;
+        frame->index = 1;
+      }
+    }
+    else {
+      while (frame->index < ins->count) {
+        u32 t = ins->targets[frame->index++];
+        if (t != frame->input) { // don't loop back
+          target = t;
+          break;
+        }
+      }
+    }
+    if (target == NO_NODE) {
+      --run->frame_count;
+      continue;
+    }
+    run->writes[frame->pc]++;
+    Node_value value = run->value[frame->pc];
+    if (target >= body->count) {
+      u32 side = target - body->count;
+      run->out[side] = value;
+      run->sides |= 1 << side;
+      continue;
+    }
+    switch (ins->op) {
+      case NODE_COPY:
+      case NODE_COPY_LR:
+      case NODE_COPY_RL:
+      case NODE_COPY_UD:
+      case NODE_COPY_DU:
+        run->value[target] = value;
+        break;
+      default:
+        break;
+    }
+    subcircuits_dispatch(run, target, frame->pc, value);
+  }
+}
+
+u32 subcircuits_equal(Body* a, Body* b) {
+  return a->width == b->width && a->height == b->height && a->count == b->count &&
+    !memcmp(a->cells, b->cells, a->width * a->height) &&
+    !memcmp(a->value, b->value, sizeof(Node_value) * a->count);
+}
+
+Result subcircuits_append(Subcircuits* subcircuits, Body* body) {
+  Body* bodies = realloc(subcircuits->bodies, sizeof(Body) * (subcircuits->body_count + 1));
+  if (!bodies) {
+    return Err;
+  }
+  subcircuits->bodies = bodies;
+  subcircuits->bodies[subcircuits->body_count++] = *body;
+  return Ok;
+}
+
+void subcircuits_write_body(Body* body, Buffer* buffer) {
+  buffer_append(buffer, &body->width, sizeof(body->width));
+  buffer_append(buffer, &body->height, sizeof(body->height));
+  buffer_append(buffer, body->cells, body->width * body->height);
+  buffer_append(buffer, body->value, sizeof(Node_value) * body->count);
+}
+
+Result subcircuits_read_body(Body* body, u32 bits, Buffer* buffer, u32* iter) {
+  *body = (Body) {0};
+  if (subcircuits_field(buffer, &body->width, sizeof(body->width), iter) != Ok || subcircuits_field(buffer, &body->height, sizeof(body->height), iter) != Ok) {
+    return Err;
+  }
+  if (body->width == 0 || body->height == 0 || body->width > MAX_SUBCIRCUIT_SIDE || body->height > MAX_SUBCIRCUIT_SIDE) {
+    return Err;
+  }
+  u32 cell_count = body->width * body->height;
+  body->cells = malloc(cell_count);
+  if (!body->cells || subcircuits_field(buffer, body->cells, cell_count, iter) != Ok) {
+    return Err;
+  }
+  u32 count = 0;
+  for (u32 c = 0; c < cell_count; ++c) {
+    if (body->cells[c] == NO_CELL) {
+      continue;
+    }
+    if (!subcircuits_allowed(body->cells[c])) {
+      return Err;
+    }
+    ++count;
+  }
+  body->value = malloc(sizeof(Node_value) * MAX(count, 1));
+  if (count == 0 || !body->value || subcircuits_read_values(body->value, count, bits, buffer, iter) != Ok) {
+    return Err;
+  }
+  return subcircuits_compile(body);
+}
+
+// values of another width are cut to the low bits, like the node values
+Result subcircuits_read_values(Node_value* values, u32 count, u32 bits, Buffer* buffer, u32* iter) {
+  if ((u64)*iter + (u64)count * (bits / 8) > buffer->size) {
+    return Err;
+  }
+  for (u32 i = 0; i < count; ++i) {
+    u64 word = 0;
+    buffer_iterate(&word, buffer, bits / 8, iter);
+    values[i] = (Node_value)word;
+  }
+  return Ok;
+}
+
+void subcircuits_free_body(Body* body) {
+  free(body->cells);
+  free(body->index);
+  free(body->value);
+  free(body->program);
+  free(body->frames);
+  *body = (Body) {0};
+}
+
+Result subcircuits_field(Buffer* buffer, void* data, u32 size, u32* iter) {
+  if ((u64)*iter + size > buffer->size) {
+    return Err;
+  }
+  buffer_iterate(data, buffer, size, iter);
+  return Ok;
+}
+
+// the number of the body goes before the extension, so save.sub is saved as
+// save.0.sub, save.1.sub and so on
+Result subcircuits_body_path(char* out, const char* path, u32 b) {
+  const char* slash = strrchr(path, '/');
+  const char* dot = strrchr(path, '.');
+  i32 size = 0;
+  if (dot && (!slash || dot > slash)) {
+    size = snprintf(out, MAX_PATH_SIZE, "%.*s.%u%s", (i32)(dot - path), path, b, dot);
+  }
+  else {
+    size = snprintf(out, MAX_PATH_SIZE, "%s.%u", path, b);
+  }
+  if (size < 0 || size >= MAX_PATH_SIZE) {
+    log_error("subcircuits_capture: the path `%s` is too long\n", path);
+    return Err;
+  }
+  return Ok;
+}
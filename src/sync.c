@@ -0,0 +1,533 @@
+// sync.c
+// every node steps once per beat, reading only the values and sends of the
+// previous beat, so the result doesn't depend on the order nodes are visited in
+
+#define SYNC_QUIET_BEATS 2
+
+static void sync_schedule(Engine* e);
+static u32 sync_steps(Engine* e, u32 c);
+static void sync_settle(Engine* e);
+static void sync_release(Engine* e, Wheel_entry* entry);
+static void sync_print(Engine* e, u32 input, Node_value value);
+
+void sync_alloc(Engine* e, Arena* arena) {
+  Sync_buffers* sync = &e->sync;
+  u32 max_node = e->state.nodes.max_node;
+  sync->value = arena_alloc(arena, sizeof(Node_value) * max_node);
+  sync->sends[0] = arena_alloc(arena, sizeof(u8) * max_node);
+  sync->sends[1] = arena_alloc(arena, sizeof(u8) * max_node);
+  sync->latch = arena_alloc(arena, sizeof(Node_value[MAX_DIR]) * max_node);
+  sync->latched = arena_alloc(arena, sizeof(u8) * max_node);
+  sync->emitted = arena_alloc(arena, sizeof(Node_value) * max_node);
+  sync->has_emitted = arena_alloc(arena, sizeof(u8) * max_node);
+  sync->active = arena_alloc(arena, sizeof(u32) * max_node);
+  sync->stepping = arena_alloc(arena, sizeof(u32) * max_node);
+  sync->quiet = arena_alloc(arena, sizeof(u8) * max_node);
+  sync->sent = arena_alloc(arena, sizeof(u8) * max_node);
+  sync->schedule_components = 0;
+  sync->wake_all = true;
+  sync->scheduled = false;
+}
+
+void sync_reset(Engine* e) {
+  Sync_buffers* sync = &e->sync;
+  u32 max_node = e->state.nodes.max_node;
+  memset(sync->sends[0], 0, max_node);
+  memset(sync->sends[1], 0, max_node);
+  memset(sync->latched, 0, max_node);
+  memset(sync->has_emitted, 0, max_node);
+  subcircuits_forget(e, NO_NODE);
+  sync->current = 0;
+  e->bits.valid = false;
+  e->bits.checked = false;
+}
+
+void sync_reset_node(Engine* e, u32 id) {
+  Sync_buffers* sync = &e->sync;
+  bitslice_flush(e);
+  sync->sends[0][id] = 0;
+  sync->sends[1][id] = 0;
+  sync->latched[id] = 0;
+  sync->has_emitted[id] = false;
+  subcircuits_forget(e, id);
+  // the neighbours forget what they heard from it
+  for (u32 d = 0; d < MAX_DIR; ++d) {
+    u32 n = e->graph.dir[id][d];
+    if (n != NO_NODE) {
+      sync->latched[n] &= ~(1 << OPPOSITE(d));
+    }
+  }
+}
+
+void sync_touch(Engine* e) {
+  bitslice_flush(e);
+}
+
+void sync_fire(Engine* e, u32 id) {
+  Sync_buffers* sync = &e->sync;
+  bitslice_flush(e);
+  u8 send = 0;
+  for (u32 d = 0; d < MAX_DIR; ++d) {
+    if (e->graph.dir[id][d] != NO_NODE) {
+      send |= 1 << d;
+    }
+  }
+  if (e->state.nodes.type[id] == NODE_SEND) {
+    send = SYNC_CHANNEL;
+  }
+  // a MACRO sends its value out of every side, or nothing without a body
+  if (e->state.nodes.type[id] == NODE_MACRO) {
+    Instance* instance = subcircuits_of(e, id);
+    for (u32 d = 0; d < MAX_DIR && instance; ++d) {
+      instance->out[sync->current][d] = e->state.nodes.data[id].value;
+    }
+    send = instance ? send : 0;
+  }
+  sync->sends[sync->current][id] = send;
+  sync_wake(e, id);
+}
+
+void sync_wake(Engine* e, u32 id) {
+  Analysis* analysis = &e->analysis;
+  Sync_buffers* sync = &e->sync;
+  // the component ids may be about to change
+  if (!analysis_current(e) || sync->schedule_generation != analysis->generation) {
+    sync->wake_all = true;
+    return;
+  }
+  if (id == NO_NODE) {
+    memset(sync->quiet, 0, analysis->component_count);
+  }
+  else {
+    sync->quiet[analysis->component[id]] = 0;
+  }
+  sync->scheduled = false;
+}
+
+void sync_simulate_beat(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  Node_graph* graph = &e->graph;
+  Sync_buffers* sync = &e->sync;
+  u32 change = e->state.mode == SIM_MODE_CHANGE;
+  if (change) {
+    bitslice_flush(e);
+  }
+  else if (bitslice_beat(e) == Ok) {
+    return;
+  }
+  u8* sent = sync->sends[sync->current];
+  u8* send = sync->sends[!sync->current];
+  channels_update(e);
+  for (u32 i = 0; i < e->wheel.due_count; ++i) {
+    sync_release(e, &e->wheel.due[i]);
+  }
+  // a clock that is due wakes its component when it went quiet
+  for (u32 i = 0; i < e->clocks.due_count; ++i) {
+    u32 id = e->clocks.due[i];
+    if (!analysis_current(e) || sync->schedule_generation != e->analysis.generation) {
+      sync_wake(e, id);
+    }
+    else if (sync->quiet[e->analysis.component[id]] >= SYNC_QUIET_BEATS && !(e->prune && !e->analysis.live[id])) {
+      sync_wake(e, id);
+    }
+  }
+  sync_schedule(e);
+  u32* component = e->analysis.component;
+
+  for (u32 i = 0; i < sync->active_count; ++i) {
+    u32 id = sync->active[i];
+    sync->value[id] = nodes->data[id].value;
+  }
+
+  for (u32 i = 0; i < sync->active_count; ++i) {
+    u32 id = sync->active[i];
+    u32* dir = graph->dir[id];
+    u8 type = nodes->type[id];
+    Node_value* value = &nodes->data[id].value;
+
+    // directional copies only listen to the side they copy from, and a RECEIVE
+    // only to its channel
+    u32 listen = (1 << MAX_DIR) - 1;
+    u32 out = NO_NODE;
+    switch (type) {
+      case NODE_RECEIVE:
+        listen = 0;
+        break;
+      case NODE_COPY_LR:
+        listen = 1 << DIR_LEFT;
+        out = DIR_RIGHT;
+        break;
+      case NODE_COPY_RL:
+        listen = 1 << DIR_RIGHT;
+        out = DIR_LEFT;
+        break;
+      case NODE_COPY_UD:
+        listen = 1 << DIR_UP;
+        out = DIR_DOWN;
+        break;
+      case NODE_COPY_DU:
+        listen = 1 << DIR_DOWN;
+        out = DIR_UP;
+        break;
+      case NODE_MEMORY:
+        listen = (1 << DIR_LEFT) | (1 << DIR_UP) | (1 << DIR_DOWN);
+        out = DIR_RIGHT;
+        break;
+      default:
+        break;
+    }
+
+    u32 inputs[MAX_DIR];
+    u32 input_sides[MAX_DIR];
+    Node_value values[MAX_DIR];
+    Node_value heard[MAX_DIR];
+    u32 count = 0;
+    u32 from = 0;
+    u32 copied = 0;
+    for (u32 d = 0; d < MAX_DIR; ++d) {
+      u32 n = dir[d];
+      if (n == NO_NODE || !(sent[n] & (1 << OPPOSITE(d)))) {
+        continue;
+      }
+      // a MACRO sends each side what left its body there
+      Instance* sender = nodes->type[n] == NODE_MACRO ? subcircuits_of(e, n) : NULL;
+      heard[d] = sender ? sender->out[sync->current][OPPOSITE(d)] : sync->value[n];
+      if (subcircuits_copies(e, n, OPPOSITE(d))) {
+        *value = heard[d]; // the sender copies into us before we read
+        copied |= 1 << d;
+      }
+      if (listen & (1 << d)) {
+        from |= 1 << d;
+        if (change) {
+          sync->latch[id][d] = heard[d];
+          sync->latched[id] |= 1 << d;
+        }
+      }
+    }
+
+    // in change mode a node only steps when something arrived, and then reads
+    // every side it has heard from. prints, delays, sends, memories and macros
+    // only take what arrived
+    u32 use = from;
+    if (change && from && type != NODE_PRINT && type != NODE_DELAY && type != NODE_SEND && type != NODE_MEMORY && type != NODE_MACRO) {
+      use = sync->latched[id] & listen;
+    }
+    for (u32 d = 0; d < MAX_DIR; ++d) {
+      if (use & (1 << d)) {
+        inputs[count] = dir[d];
+        input_sides[count] = d;
+        values[count] = change ? sync->latch[id][d] : heard[d];
+        ++count;
+      }
+    }
+    // of the SENDs that wrote to the channel the last one by id wins
+    if (type == NODE_RECEIVE) {
+      Channel* channel = channels_of(e, id);
+      for (u32 s = 0; s < channel->send_count; ++s) {
+        u32 n = e->channels.members[channel->first + s];
+        if (sent[n] & SYNC_CHANNEL) {
+          inputs[0] = n;
+          values[0] = sync->value[n];
+          count = 1;
+        }
+      }
+    }
+
+    u32 fire = false;
+    u32 sides = 0;
+    switch (type) {
+      case NODE_NONE:
+        break;
+      case NODE_CLOCK:
+        if (e->clocks.fires[id]) {
+          *value += 1;
+          fire = true;
+          sync->sent[component[id]] = true;
+        }
+        break;
+      case NODE_ADD:
+        if (count >= 2) {
+          *value += values[0] + values[1];
+          fire = true;
+        }
+        break;
+      case NODE_BUS:
+        fire = count > 0;
+        break;
+      case NODE_AND:
+        if (count >= 2) {
+          *value = values[0] && values[1];
+          fire = *value != 0;
+        }
+        break;
+      case NODE_PRINT:
+        for (u32 n = 0; n < count; ++n) {
+          *value = values[n];
+          sync_print(e, inputs[n], *value);
+        }
+        break;
+      case NODE_INCR:
+        for (u32 n = 0; n < count; ++n) {
+          *value += values[n];
+        }
+        fire = count > 0;
+        break;
+      case NODE_NOT:
+        if (count > 0) {
+          *value = !values[0];
+          fire = true;
+        }
+        break;
+      case NODE_COPY:
+        if (count > 0) {
+          *value = values[0];
+          fire = true;
+        }
+        break;
+      case NODE_EQUALS:
+        if (count >= 2) {
+          *value = values[0] == values[1];
+          fire = *value != 0;
+        }
+        break;
+      case NODE_COPY_LR:
+      case NODE_COPY_RL:
+      case NODE_COPY_UD:
+      case NODE_COPY_DU:
+        if (count > 0) {
+          *value = values[0];
+          fire = dir[out] != NO_NODE;
+        }
+        break;
+      case NODE_DELAY:
+        if (count > 0) {
+          wheel_schedule(e, id, inputs[0], values[0]);
+        }
+        break;
+      case NODE_SEND:
+        if (count > 0) {
+          *value = values[0];
+          fire = true;
+        }
+        break;
+      case NODE_RECEIVE:
+        if (count > 0) {
+          *value = values[0];
+          fire = true;
+        }
+        break;
+      case NODE_MEMORY: {
+        // the inputs are in side order, so what arrives together sets the
+        // address and the data before it is written, and is loaded after
+        Bank* bank = banks_of(e, id);
+        if (!bank) {
+          break;
+        }
+        Node_value* words = banks_words(e, bank);
+        u32 load = false;
+        for (u32 n = 0; n < count; ++n) {
+          if (inputs[n] == dir[DIR_LEFT]) {
+            bank->address = values[n] & BANK_MASK;
+            load = true;
+          }
+          else if (inputs[n] == dir[DIR_UP]) {
+            bank->data = values[n];
+          }
+          else if (values[n] != 0) {
+            words[bank->address] = bank->data;
+          }
+        }
+        if (load) {
+          *value = words[bank->address];
+          fire = dir[out] != NO_NODE;
+        }
+        break;
+      }
+      case NODE_MACRO: {
+        // its body runs into the buffer of the next beat, so the neighbours
+        // still read what it sent on this one
+        Instance* instance = subcircuits_of(e, id);
+        if (!instance) {
+          break;
+        }
+        Node_value* next = instance->out[!sync->current];
+        for (u32 n = 0; n < count; ++n) {
+          u32 d = input_sides[n];
+          sides |= subcircuits_run(e, id, d, values[n], (copied >> d) & 1, nodes->type[inputs[n]], next);
+        }
+        for (u32 d = 0; d < MAX_DIR; ++d) {
+          if (dir[d] == NO_NODE) {
+            sides &= ~(1 << d);
+          }
+        }
+        if (change) {
+          sides = subcircuits_changed(e, id, sides, next);
+        }
+        for (u32 d = 0; d < MAX_DIR; ++d) {
+          if (sides & (1 << d)) {
+            *value = next[d];
+          }
+        }
+        fire = sides != 0;
+        break;
+      }
+      default:
+        assert(0);
+        break;
+    }
+
+    if (change && fire && type != NODE_MACRO) {
+      if (sync->has_emitted[id] && sync->emitted[id] == *value) {
+        fire = false;
+      }
+      else {
+        sync->emitted[id] = *value;
+        sync->has_emitted[id] = true;
+      }
+    }
+
+    if (count > 0) {
+      e->node_colors[id] = colors[COLOR_GREEN];
+    }
+    send[id] = 0;
+    if (fire) {
+      if (type == NODE_SEND) {
+        send[id] = SYNC_CHANNEL;
+      }
+      else if (type == NODE_MACRO) {
+        send[id] = sides;
+      }
+      else if (out != NO_NODE) {
+        send[id] = 1 << out;
+      }
+      else {
+        // broadcast to every neighbour except the ones we just heard from
+        for (u32 d = 0; d < MAX_DIR; ++d) {
+          if (dir[d] != NO_NODE && !(from & (1 << d))) {
+            send[id] |= 1 << d;
+          }
+        }
+      }
+      if (send[id]) {
+        e->node_colors[id] = colors[COLOR_RED];
+        sync->sent[component[id]] = true;
+      }
+    }
+    if (count > 0 || fire) {
+      e->event_count++;
+    }
+  }
+  sync_settle(e);
+  sync->current = !sync->current;
+}
+
+void sync_schedule(Engine* e) {
+  Node_index* index = &e->index;
+  Analysis* analysis = &e->analysis;
+  Sync_buffers* sync = &e->sync;
+  analysis_update(e);
+  if (sync->schedule_generation != analysis->generation) {
+    // components that kept their id keep stepping or staying out as before
+    u32 first = sync->schedule_rebuilds == analysis->rebuilds ? sync->schedule_components : 0;
+    memset(&sync->quiet[first], 0, analysis->component_count - first);
+    memset(&sync->sent[first], 0, analysis->component_count - first);
+    sync->schedule_generation = analysis->generation;
+    sync->schedule_rebuilds = analysis->rebuilds;
+    sync->schedule_components = analysis->component_count;
+    sync->scheduled = false;
+  }
+  if (sync->wake_all) {
+    memset(sync->quiet, 0, analysis->component_count);
+    sync->wake_all = false;
+    sync->scheduled = false;
+  }
+  if (sync->schedule_prune != e->prune) {
+    sync->schedule_prune = e->prune;
+    sync->scheduled = false;
+  }
+  if (sync->scheduled) {
+    return;
+  }
+  u32 all = !e->prune;
+  sync->stepping_count = 0;
+  for (u32 c = 0; c < analysis->component_count; ++c) {
+    if (sync_steps(e, c)) {
+      sync->stepping[sync->stepping_count++] = c;
+    }
+    else if (analysis->components[c].count > 0) {
+      all = false;
+    }
+  }
+  if (all) {
+    memcpy(sync->active, index->alive, sizeof(u32) * index->alive_count);
+    sync->active_count = index->alive_count;
+  }
+  else {
+    // a dead node fired by hand sends to every side, live ones included
+    sync->active_count = 0;
+    for (u32 i = 0; i < index->alive_count; ++i) {
+      u32 id = index->alive[i];
+      u32 dead = e->prune && !analysis->live[id] && !sync->sends[0][id] && !sync->sends[1][id];
+      if (sync_steps(e, analysis->component[id]) && !dead) {
+        sync->active[sync->active_count++] = id;
+      }
+    }
+  }
+  sync->scheduled = true;
+}
+
+u32 sync_steps(Engine* e, u32 c) {
+  Component* component = &e->analysis.components[c];
+  if (component->count == 0 || (e->prune && component->live_count == 0)) {
+    return false;
+  }
+  return e->sync.quiet[c] < SYNC_QUIET_BEATS;
+}
+
+// a value let go by a DELAY goes out like a click, to every neighbour but the
+// one it came from
+void sync_release(Engine* e, Wheel_entry* entry) {
+  Nodes* nodes = &e->state.nodes;
+  Sync_buffers* sync = &e->sync;
+  u32 id = entry->node;
+  if (!nodes->alive[id] || nodes->type[id] != NODE_DELAY || (e->prune && !e->analysis.live[id])) {
+    return;
+  }
+  nodes->data[id].value = entry->value;
+  u8 send = 0;
+  for (u32 d = 0; d < MAX_DIR; ++d) {
+    u32 n = e->graph.dir[id][d];
+    if (n != NO_NODE && n != entry->input) {
+      send |= 1 << d;
+    }
+  }
+  sync->sends[sync->current][id] = send;
+  e->node_colors[id] = colors[COLOR_RED];
+  e->event_count++;
+  sync_wake(e, id);
+}
+
+// components that went quiet drop out of the schedule
+void sync_settle(Engine* e) {
+  Sync_buffers* sync = &e->sync;
+  for (u32 i = 0; i < sync->stepping_count; ++i) {
+    u32 c = sync->stepping[i];
+    if (sync->sent[c]) {
+      sync->quiet[c] = 0;
+      sync->sent[c] = false;
+      continue;
+    }
+    if (sync->quiet[c] < SYNC_QUIET_BEATS) {
+      sync->quiet[c]++;
+      if (sync->quiet[c] == SYNC_QUIET_BEATS) {
+        sync->scheduled = false;
+      }
+    }
+  }
+}
+
+void sync_print(Engine* e, u32 input, Node_value value) {
+  Nodes* nodes = &e->state.nodes;
+  signal_engine_log(e, "node", "%s: " NODE_VALUE_FMT, node_type_str[nodes->type[input]], value);
+  log_info("%s: " NODE_VALUE_FMT "\n", node_type_str[nodes->type[input]], value);
+}
@@ -0,0 +1,389 @@
+// tiles.c
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct {
+  Vm vm;
+  u32* clocks; // into the due clocks, those of components that stay in the tile
+  u32 clock_count;
+  u32* print_end; // the print count of the vm after each of its clocks
+  u32 clock_next; // the next clock whose prints are logged
+  u32 print_next;
+  Vm_frame* frames;
+  Vm_print* prints;
+  u32* not_ready;
+} Tile;
+
+// tiles waiting to be run, the owner pops from the tail and thieves take from the head
+typedef struct {
+  u32* tasks;
+  u32 head;
+  u32 tail;
+  pthread_mutex_t lock;
+} Tile_deque;
+
+typedef struct {
+  pthread_t threads[MAX_TILE_WORKER];
+  Tile_deque deques[MAX_TILE_WORKER];
+  u32 worker_count; // the main thread is worker 0
+  u32 running;
+  u32 round;
+  u32 pending;
+  u32 quit;
+  Engine* e;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+} Tile_pool;
+
+static Tile* tiles = NULL;
+static u32 tile_count = 0;
+static u32 tile_nodes = 0; // node ids per tile
+static u32* tile_tasks = NULL;
+static u32* tile_owner = NULL; // of every due clock, its tile or NO_NODE
+static u8* tile_local = NULL; // of every component, whether it stays in one tile
+static u32 tile_generation = 0; // of the analysis tile_local was found from
+static u32 tile_located = false;
+static Arena tile_arena = {0};
+static u32 tile_threads = 0;
+static Tile_pool pool = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .wake = PTHREAD_COND_INITIALIZER,
+  .done = PTHREAD_COND_INITIALIZER,
+};
+
+static Result tiles_alloc(Engine* e);
+static void tiles_carve(Arena* arena, u32 count);
+static void tiles_start(void);
+static void tiles_stop(void);
+static void* tiles_worker(void* arg);
+static void tiles_work(u32 worker);
+static u32 tiles_pop(u32 worker, u32* task);
+static void tiles_execute(Engine* e, u32* tasks, u32 count);
+static void tiles_locate(Engine* e);
+static void tile_run(Engine* e, u32 t);
+
+void tiles_set_threads(u32 threads) {
+  if (threads != tile_threads) {
+    tiles_destroy();
+  }
+  tile_threads = threads;
+}
+
+void tiles_destroy(void) {
+  if (pool.running) {
+    tiles_stop();
+  }
+  arena_free(&tile_arena);
+  tiles = NULL;
+  tile_count = 0;
+  tile_nodes = 0;
+  tile_located = false;
+}
+
+void tiles_stop(void) {
+  pthread_mutex_lock(&pool.lock);
+  pool.quit = true;
+  pthread_cond_broadcast(&pool.wake);
+  pthread_mutex_unlock(&pool.lock);
+  for (u32 i = 1; i < pool.worker_count; ++i) {
+    pthread_join(pool.threads[i], NULL);
+  }
+  for (u32 i = 0; i < pool.worker_count; ++i) {
+    pthread_mutex_destroy(&pool.deques[i].lock);
+  }
+  pool.running = false;
+  pool.quit = false;
+}
+
+// one arena for the tiles and all of their buffers, sized for the current grid
+Result tiles_alloc(Engine* e) {
+  Nodes* nodes = &e->state.nodes;
+  u32 per_tile = TILE_ROWS * nodes->grid_width;
+  u32 count = (nodes->max_node + per_tile - 1) / per_tile;
+  if (tiles && tile_nodes == per_tile && tile_count == count) {
+    return Ok;
+  }
+  tiles_destroy();
+  tile_nodes = per_tile;
+  Arena measure = {0};
+  tiles_carve(&measure, count);
+  if (arena_init(&tile_arena, measure.used, false) != Ok) {
+    tile_nodes = 0;
+    return Err;
+  }
+  tiles_carve(&tile_arena, count);
+  tile_count = count;
+  return Ok;
+}
+
+// a cascade can re-enter every node once per write. the tiles cover at least
+// every node, so a table per node or component is sized by them
+void tiles_carve(Arena* arena, u32 count) {
+  u32 max_node = count * tile_nodes;
+  tiles = arena_alloc(arena, sizeof(Tile) * count);
+  tile_tasks = arena_alloc(arena, sizeof(u32) * count);
+  tile_owner = arena_alloc(arena, sizeof(u32) * max_node);
+  tile_local = arena_alloc(arena, sizeof(u8) * max_node);
+  for (u32 i = 0; i < MAX_TILE_WORKER; ++i) {
+    pool.deques[i].tasks = arena_alloc(arena, sizeof(u32) * count);
+  }
+  for (u32 t = 0; t < count; ++t) {
+    Tile tile = {
+      .clocks = arena_alloc(arena, sizeof(u32) * tile_nodes),
+      .print_end = arena_alloc(arena, sizeof(u32) * tile_nodes),
+      .frames = arena_alloc(arena, sizeof(Vm_frame) * tile_nodes * (MAX_WRITES + 1)),
+      .prints = arena_alloc(arena, sizeof(Vm_print) * tile_nodes * MAX_READS),
+      .not_ready = arena_alloc(arena, sizeof(u32) * tile_nodes),
+    };
+    if (tiles) {
+      tiles[t] = tile;
+    }
+  }
+}
+
+void tiles_start(void) {
+  u32 count = tile_threads;
+  if (count == 0) {
+    i32 cores = sysconf(_SC_NPROCESSORS_ONLN);
+    count = cores > 0 ? (u32)cores : 1;
+  }
+  count = CLAMP(count, 1, MIN(MAX_TILE_WORKER, tile_count));
+
+  pool.worker_count = count;
+  pool.round = 0;
+  pool.pending = 0;
+  pool.quit = false;
+  for (u32 i = 0; i < count; ++i) {
+    Tile_deque* deque = &pool.deques[i];
+    deque->head = deque->tail = 0;
+    pthread_mutex_init(&deque->lock, NULL);
+  }
+  for (u32 i = 1; i < count; ++i) {
+    if (pthread_create(&pool.threads[i], NULL, tiles_worker, (void*)(uintptr_t)i) != 0) {
+      log_error("failed to create tile worker, running on %u threads\n", i);
+      pool.worker_count = i;
+      break;
+    }
+  }
+  pool.running = true;
+}
+
+void* tiles_worker(void* arg) {
+  u32 worker = (u32)(uintptr_t)arg;
+  u32 seen = 0;
+  for (;;) {
+    pthread_mutex_lock(&pool.lock);
+    while (pool.round == seen && !pool.quit) {
+      pthread_cond_wait(&pool.wake, &pool.lock);
+    }
+    if (pool.quit) {
+      pthread_mutex_unlock(&pool.lock);
+      break;
+    }
+    seen = pool.round;
+    pthread_mutex_unlock(&pool.lock);
+    tiles_work(worker);
+  }
+  return NULL;
+}
+
+void tiles_work(u32 worker) {
+  u32 task = 0;
+  while (tiles_pop(worker, &task)) {
+    tile_run(pool.e, task);
+    pthread_mutex_lock(&pool.lock);
+    if (--pool.pending == 0) {
+      pthread_cond_signal(&pool.done);
+    }
+    pthread_mutex_unlock(&pool.lock);
+  }
+}
+
+// take from our own deque first, then steal from the others
+u32 tiles_pop(u32 worker, u32* task) {
+  Tile_deque* own = &pool.deques[worker];
+  pthread_mutex_lock(&own->lock);
+  if (own->tail > own->head) {
+    *task = own->tasks[--own->tail];
+    pthread_mutex_unlock(&own->lock);
+    return true;
+  }
+  pthread_mutex_unlock(&own->lock);
+
+  for (u32 i = 1; i < pool.worker_count; ++i) {
+    Tile_deque* victim = &pool.deques[(worker + i) % pool.worker_count];
+    pthread_mutex_lock(&victim->lock);
+    if (victim->tail > victim->head) {
+      *task = victim->tasks[victim->head++];
+      pthread_mutex_unlock(&victim->lock);
+      return true;
+    }
+    pthread_mutex_unlock(&victim->lock);
+  }
+  return false;
+}
+
+void tiles_execute(Engine* e, u32* tasks, u32 count) {
+  if (!pool.running) {
+    tiles_start();
+  }
+  if (pool.worker_count == 1) {
+    for (u32 i = 0; i < count; ++i) {
+      tile_run(e, tasks[i]);
+    }
+    return;
+  }
+
+  // workers that are still looking for work from the last round may pick up
+  // these tasks as soon as they are pushed, so they have to be counted first
+  pthread_mutex_lock(&pool.lock);
+  pool.e = e;
+  pool.pending = count;
+  pthread_mutex_unlock(&pool.lock);
+  for (u32 i = 0; i < count; ++i) {
+    Tile_deque* deque = &pool.deques[i % pool.worker_count];
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head == deque->tail) {
+      deque->head = deque->tail = 0;
+    }
+    deque->tasks[deque->tail++] = tasks[i];
+    pthread_mutex_unlock(&deque->lock);
+  }
+
+  pthread_mutex_lock(&pool.lock);
+  pool.round++;
+  pthread_cond_broadcast(&pool.wake);
+  pthread_mutex_unlock(&pool.lock);
+
+  tiles_work(0);
+
+  pthread_mutex_lock(&pool.lock);
+  while (pool.pending > 0) {
+    pthread_cond_wait(&pool.done, &pool.lock);
+  }
+  pthread_mutex_unlock(&pool.lock);
+}
+
+// a component that stays in one tile only reaches the nodes of its own tile.
+// found again when the components changed
+void tiles_locate(Engine* e) {
+  Analysis* analysis = &e->analysis;
+  analysis_update(e);
+  if (tile_located && tile_generation == analysis->generation) {
+    return;
+  }
+  for (u32 c = 0; c < analysis->component_count; ++c) {
+    Component* component = &analysis->components[c];
+    u32* members = &analysis->members[component->first];
+    u32 local = true;
+    for (u32 m = 1; m < component->count && local; ++m) {
+      local = members[m] / tile_nodes == members[0] / tile_nodes;
+    }
+    tile_local[c] = local;
+  }
+  tile_generation = analysis->generation;
+  tile_located = true;
+}
+
+// a tile only writes to the nodes it owns, its own buffers and the not ready
+// flags of its own nodes, so tiles never touch the same data
+void tile_run(Engine* e, u32 t) {
+  Tile* tile = &tiles[t];
+  for (u32 i = 0; i < tile->clock_count; ++i) {
+    netlist_fire(e, &tile->vm, e->netlist.pc[e->clocks.due[tile->clocks[i]]]);
+    tile->print_end[i] = tile->vm.print_count;
+  }
+}
+
+void tiles_trigger_clocks(Engine* e) {
+  Netlist* netlist = &e->netlist;
+  Node_index* index = &e->index;
+  netlist_update(e);
+  // a DELAY schedules into the one wheel of the engine, a SEND writes to
+  // tiles that may be anywhere on the grid, and the MACROs of a body share its
+  // frames
+  if (netlist->delay_count > 0 || netlist->channel_count > 0 || netlist->macro_count > 0) {
+    netlist_trigger_clocks(e);
+    return;
+  }
+  if (tiles_alloc(e) != Ok) {
+    log_error("failed to allocate tiles, running the beat on the netlist interpreter\n");
+    netlist_trigger_clocks(e);
+    return;
+  }
+  tiles_locate(e);
+  u32* tasks = tile_tasks;
+
+  // only the components inside a tile are given to it, so it never leaves its range
+  for (u32 t = 0; t < tile_count; ++t) {
+    Tile* tile = &tiles[t];
+    tile->vm = (Vm) {
+      .first = t * tile_nodes,
+      .last = MIN((t + 1) * tile_nodes, e->state.nodes.max_node),
+      .frames = tile->frames,
+      .max_frame = tile_nodes * (MAX_WRITES + 1),
+      .prints = tile->prints,
+      .max_print = tile_nodes * MAX_READS,
+      .not_ready = tile->not_ready,
+    };
+    tile->clock_count = 0;
+    tile->clock_next = 0;
+    tile->print_next = 0;
+  }
+  for (u32 i = 0; i < e->clocks.due_count; ++i) {
+    u32 id = e->clocks.due[i];
+    tile_owner[i] = NO_NODE;
+    if (tile_local[e->analysis.component[id]]) {
+      Tile* tile = &tiles[id / tile_nodes];
+      tile->clocks[tile->clock_count++] = i;
+      tile_owner[i] = id / tile_nodes;
+    }
+  }
+
+  u32 count = 0;
+  for (u32 t = 0; t < tile_count; ++t) {
+    if (tiles[t].clock_count > 0) {
+      tasks[count++] = t;
+    }
+  }
+  if (count > 0) {
+    tiles_execute(e, tasks, count);
+  }
+
+  // components never reach each other, so the ones that cross tiles can run
+  // after the others. they run in clock order as on one vm, and the prints of
+  // the tiles are logged in between where their clocks are
+  Vm serial = {
+    .first = 0,
+    .last = e->state.nodes.max_node,
+    .frames = netlist->frames,
+    .max_frame = netlist->max_frame,
+    .not_ready = index->not_ready,
+    .not_ready_count = index->not_ready_count,
+  };
+  for (u32 i = 0; i < e->clocks.due_count; ++i) {
+    if (tile_owner[i] == NO_NODE) {
+      netlist_fire(e, &serial, netlist->pc[e->clocks.due[i]]);
+      continue;
+    }
+    Tile* tile = &tiles[tile_owner[i]];
+    u32 end = tile->print_end[tile->clock_next++];
+    for (; tile->print_next < end; ++tile->print_next) {
+      Vm_print* print = &tile->prints[tile->print_next];
+      signal_engine_log(e, "node", "%s: " NODE_VALUE_FMT, node_type_str[print->type], print->value);
+      log_info("%s: " NODE_VALUE_FMT "\n", node_type_str[print->type], print->value);
+    }
+  }
+  index->not_ready_count = serial.not_ready_count;
+  e->event_count += serial.event_count;
+
+  for (u32 t = 0; t < tile_count; ++t) {
+    Vm* vm = &tiles[t].vm;
+    for (u32 i = 0; i < vm->not_ready_count; ++i) {
+      index->not_ready[index->not_ready_count++] = vm->not_ready[i];
+    }
+    e->event_count += vm->event_count;
+  }
+}
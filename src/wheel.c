@@ -0,0 +1,253 @@
+// wheel.c
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_MIN_ENTRY 256
+
+static void wheel_insert(Wheel* wheel, u32 i);
+static void wheel_cascade(Wheel* wheel, u32 level);
+static int wheel_order_due(const void* a, const void* b);
+static int wheel_order_pending(const void* a, const void* b);
+
+void wheel_schedule(Engine* e, u32 node, u32 input, Node_value value) {
+  Wheel* wheel = &e->wheel;
+  if (wheel->free == NO_NODE) {
+    u32 max_entry = wheel->max_entry ? 2 * wheel->max_entry : WHEEL_MIN_ENTRY;
+    Wheel_entry* entries = realloc(wheel->entries, sizeof(Wheel_entry) * max_entry);
+    if (!entries) {
+      log_error("wheel: failed to allocate %u entries, dropping a value of node %u\n", max_entry, node);
+      return;
+    }
+    for (u32 i = wheel->max_entry; i < max_entry; ++i) {
+      entries[i].next = i + 1 < max_entry ? i + 1 : NO_NODE;
+    }
+    wheel->free = wheel->max_entry;
+    wheel->entries = entries;
+    wheel->max_entry = max_entry;
+  }
+  u32 i = wheel->free;
+  Wheel_entry* entry = &wheel->entries[i];
+  wheel->free = entry->next;
+  *entry = (Wheel_entry) {
+    .node = node,
+    .input = input,
+    .due = wheel->now + MAX(e->state.nodes.delay[node], 1),
+    .seq = wheel->seq++,
+    .value = value,
+  };
+  wheel->count++;
+  wheel_insert(wheel, i);
+}
+
+void wheel_advance(Engine* e) {
+  Wheel* wheel = &e->wheel;
+  wheel->now++;
+  wheel->due_count = 0;
+  if (wheel->count == 0) {
+    return;
+  }
+  for (u32 level = 1; level < WHEEL_LEVELS; ++level) {
+    if ((wheel->now >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK) {
+      break;
+    }
+    wheel_cascade(wheel, level);
+  }
+  u32* slot = &wheel->slots[0][wheel->now & WHEEL_MASK];
+  u32 count = 0;
+  for (u32 i = *slot; i != NO_NODE; i = wheel->entries[i].next) {
+    ++count;
+  }
+  if (count > wheel->max_due) {
+    Wheel_entry* due = realloc(wheel->due, sizeof(Wheel_entry) * count);
+    if (!due) {
+      log_error("wheel: failed to allocate %u due entries\n", count);
+      return;
+    }
+    wheel->due = due;
+    wheel->max_due = count;
+  }
+  u32 i = *slot;
+  while (i != NO_NODE) {
+    Wheel_entry* entry = &wheel->entries[i];
+    u32 next = entry->next;
+    wheel->due[wheel->due_count++] = *entry;
+    entry->next = wheel->free;
+    wheel->free = i;
+    wheel->count--;
+    i = next;
+  }
+  *slot = NO_NODE;
+  if (wheel->due_count == 0) {
+    return;
+  }
+  // let go in id order, like the clocks fire
+  qsort(wheel->due, wheel->due_count, sizeof(Wheel_entry), wheel_order_due);
+}
+
+void wheel_cancel(Engine* e, u32 node) {
+  Wheel* wheel = &e->wheel;
+  if (wheel->count == 0) {
+    return;
+  }
+  for (u32 level = 0; level < WHEEL_LEVELS; ++level) {
+    for (u32 s = 0; s < WHEEL_SLOTS; ++s) {
+      u32* link = &wheel->slots[level][s];
+      while (*link != NO_NODE) {
+        u32 i = *link;
+        Wheel_entry* entry = &wheel->entries[i];
+        if (entry->node != node) {
+          link = &entry->next;
+          continue;
+        }
+        *link = entry->next;
+        entry->next = wheel->free;
+        wheel->free = i;
+        wheel->count--;
+      }
+    }
+  }
+}
+
+void wheel_skip(Engine* e, u64 beats) {
+  Wheel* wheel = &e->wheel;
+  u32 held = NO_NODE;
+  for (u32 level = 0; level < WHEEL_LEVELS; ++level) {
+    for (u32 s = 0; s < WHEEL_SLOTS; ++s) {
+      u32 i = wheel->slots[level][s];
+      wheel->slots[level][s] = NO_NODE;
+      while (i != NO_NODE) {
+        Wheel_entry* entry = &wheel->entries[i];
+        u32 next = entry->next;
+        entry->due += beats;
+        entry->next = held;
+        held = i;
+        i = next;
+      }
+    }
+  }
+  wheel->now += beats;
+  while (held != NO_NODE) {
+    u32 next = wheel->entries[held].next;
+    wheel_insert(wheel, held);
+    held = next;
+  }
+}
+
+void wheel_clear(Engine* e) {
+  Wheel* wheel = &e->wheel;
+  for (u32 level = 0; level < WHEEL_LEVELS; ++level) {
+    for (u32 s = 0; s < WHEEL_SLOTS; ++s) {
+      wheel->slots[level][s] = NO_NODE;
+    }
+  }
+  for (u32 i = 0; i < wheel->max_entry; ++i) {
+    wheel->entries[i].next = i + 1 < wheel->max_entry ? i + 1 : NO_NODE;
+  }
+  wheel->free = wheel->max_entry ? 0 : NO_NODE;
+  wheel->count = 0;
+  wheel->due_count = 0;
+}
+
+void wheel_destroy(Engine* e) {
+  Wheel* wheel = &e->wheel;
+  free(wheel->entries);
+  free(wheel->due);
+  free(wheel->pending);
+  wheel->entries = NULL;
+  wheel->max_entry = 0;
+  wheel->due = NULL;
+  wheel->max_due = 0;
+  wheel->pending = NULL;
+  wheel->max_pending = 0;
+  wheel_clear(e);
+}
+
+Result wheel_pending(Engine* e, Wheel_pending** pending, u64* size) {
+  Wheel* wheel = &e->wheel;
+  *pending = NULL;
+  *size = 0;
+  if (wheel->count == 0) {
+    return Ok;
+  }
+  if (wheel->count > wheel->max_pending) {
+    Wheel_pending* p = realloc(wheel->pending, sizeof(Wheel_pending) * wheel->count);
+    if (!p) {
+      log_error("wheel: failed to allocate %u pending entries\n", wheel->count);
+      return Err;
+    }
+    wheel->pending = p;
+    wheel->max_pending = wheel->count;
+  }
+  u32 count = 0;
+  for (u32 level = 0; level < WHEEL_LEVELS; ++level) {
+    for (u32 s = 0; s < WHEEL_SLOTS; ++s) {
+      for (u32 i = wheel->slots[level][s]; i != NO_NODE; i = wheel->entries[i].next) {
+        Wheel_entry* entry = &wheel->entries[i];
+        wheel->pending[count++] = (Wheel_pending) {
+          .node = entry->node,
+          .input = entry->input,
+          .wait = entry->due - wheel->now,
+          .order = entry->seq,
+          .value = entry->value,
+        };
+      }
+    }
+  }
+  // sorted by when and in which order they are let go. the seq only matters
+  // between the entries of a node due on the same beat, so it is replaced by
+  // the place among those
+  qsort(wheel->pending, count, sizeof(Wheel_pending), wheel_order_pending);
+  for (u32 i = 0; i < count; ++i) {
+    Wheel_pending* p = &wheel->pending[i];
+    u32 first = i == 0 || p[-1].wait != p->wait || p[-1].node != p->node;
+    p->order = first ? 0 : p[-1].order + 1;
+  }
+  *pending = wheel->pending;
+  *size = sizeof(Wheel_pending) * count;
+  return Ok;
+}
+
+// the level is picked by how far away it is due, and the slot by the bits of
+// the due beat for that level
+void wheel_insert(Wheel* wheel, u32 i) {
+  Wheel_entry* entry = &wheel->entries[i];
+  u64 wait = entry->due - wheel->now;
+  u32 level = 0;
+  while (level + 1 < WHEEL_LEVELS && wait >= (1ull << (WHEEL_BITS * (level + 1)))) {
+    ++level;
+  }
+  u32* slot = &wheel->slots[level][(entry->due >> (WHEEL_BITS * level)) & WHEEL_MASK];
+  entry->next = *slot;
+  *slot = i;
+}
+
+void wheel_cascade(Wheel* wheel, u32 level) {
+  u32* slot = &wheel->slots[level][(wheel->now >> (WHEEL_BITS * level)) & WHEEL_MASK];
+  u32 i = *slot;
+  *slot = NO_NODE;
+  while (i != NO_NODE) {
+    u32 next = wheel->entries[i].next;
+    wheel_insert(wheel, i);
+    i = next;
+  }
+}
+
+int wheel_order_due(const void* a, const void* b) {
+  const Wheel_entry* x = a;
+  const Wheel_entry* y = b;
+  if (x->node != y->node) {
+    return x->node < y->node ? -1 : 1;
+  }
+  return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+int wheel_order_pending(const void* a, const void* b) {
+  const Wheel_pending* x = a;
+  const Wheel_pending* y = b;
+  if (x->wait != y->wait) {
+    return x->wait < y->wait ? -1 : 1;
+  }
+  if (x->node != y->node) {
+    return x->node < y->node ? -1 : 1;
+  }
+  return x->order < y->order ? -1 : x->order > y->order;
+}